@@ -0,0 +1,162 @@
+// Arduino API и аппаратный слой (src/hal.h) для хост-сборки: всё сводится
+// к модели установки (plant.cpp) и виртуальным часам.
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <LiquidCrystal_I2C.h>
+#include <map>
+#include <string>
+#include "hal.h"
+#include "plant.h"
+
+#define SIM_CPU_MHZ     240            // Частота виртуального CPU (для счётчика тактов)
+#define SIM_UART_ROOM   128            // Свободно в буфере UART на каждый опрос (FIFO ESP32)
+
+HardwareSerial Serial;
+TwoWire Wire;
+
+// ---------------- пины и время ----------------
+
+void pinMode(int pin, int mode) { plantPinMode(pin, mode); }
+int digitalRead(int pin) { return plantPinRead(pin); }
+void digitalWrite(int pin, int level) { plantPinWrite(pin, level); }
+int analogRead(int pin) {
+  (void)pin;
+  static uint32_t rng = 1;
+  rng = rng * 1664525u + 1013904223u;
+  int noise = plant.potNoise ? (int)((rng >> 8) % (2 * plant.potNoise + 1)) - plant.potNoise : 0;
+  return constrain(plant.potAdc + noise, 0, 4095);
+}
+
+unsigned long millis() { return (unsigned long)((plant.nowUs - plant.bootUs) / 1000); }
+unsigned long micros() { return (unsigned long)(plant.nowUs - plant.bootUs); }
+void delay(unsigned long ms) { plantAdvance((uint64_t)ms * 1000); }
+
+void ledcSetup(int channel, int freq, int bits) { (void)channel; (void)freq; (void)bits; }
+void ledcAttachPin(int pin, int channel) { (void)pin; (void)channel; }
+void ledcWrite(int channel, int duty) { (void)channel; (void)duty; }
+
+void attachInterruptArg(int pin, void (*isr)(void *), void *arg, int mode) { plantAttachIsr(pin, isr, arg, mode); }
+
+// ---------------- hal.h ----------------
+
+static void outWrite(PinMask m, int level) {
+  for (int bit = 0; bit < 32; bit++) {
+    if (m.lo & (1UL << bit)) plantPinWrite(bit, level);
+    if (m.hi & (1UL << bit)) plantPinWrite(bit + 32, level);
+  }
+}
+
+void halOutHigh(PinMask m) { outWrite(m, HIGH); }
+void halOutLow(PinMask m) { outWrite(m, LOW); }
+
+bool halPinLevel(int pin) { return plantPinRead(pin) == HIGH; }
+uint32_t halCycleCount() { return (uint32_t)(plant.nowUs * SIM_CPU_MHZ); }
+uint32_t halCpuMhz() { return SIM_CPU_MHZ; }
+uint32_t halHeapFree() { return 0; }                 // Кучу хоста не отслеживаем
+
+void halHeapInfo(HalHeapInfo &info) { memset(&info, 0, sizeof(info)); }
+
+// Файлы — в памяти процесса (журнал живёт до конца прогона)
+static std::map<std::string, std::string> files;
+
+// Каждое обращение к flash на ESP32 останавливает кэш обоих ядер — при работающей помпе нельзя
+static void flashTouch() {
+  if (plantPumping()) plant.flashWhilePumping++;
+}
+
+bool halFsBegin() { return true; }
+
+long halFsSize(const char *path) {
+  flashTouch();
+  auto it = files.find(path);
+  return it == files.end() ? -1 : (long)it->second.size();
+}
+
+bool halFsAppend(const char *path, const void *data, size_t n) {
+  flashTouch();
+  files[path].append((const char *)data, n);
+  return true;
+}
+
+size_t halFsRead(const char *path, size_t offset, void *buf, size_t n) {
+  flashTouch();
+  auto it = files.find(path);
+  if (it == files.end() || offset >= it->second.size()) return 0;
+  size_t got = std::min(n, it->second.size() - offset);
+  memcpy(buf, it->second.data() + offset, got);
+  return got;
+}
+
+void halFsRemove(const char *path) {
+  flashTouch();
+  files.erase(path);
+}
+
+const char *halResetReason() { return plant.resets ? "brownout" : "poweron"; }
+
+// Воспроизводимый прогон: LCG, состояние переживает сброс прошивки
+uint32_t halRandom() {
+  static uint32_t x = 1;
+  x = x * 1664525u + 1013904223u;
+  return x;
+}
+
+// ---------------- Serial ----------------
+
+static std::string serialIn;
+static std::string serialOut;
+
+void HardwareSerial::begin(unsigned long baud) { (void)baud; }
+int HardwareSerial::available() { return (int)serialIn.size(); }
+int HardwareSerial::availableForWrite() { return SIM_UART_ROOM; }
+
+int HardwareSerial::read() {
+  if (serialIn.empty()) return -1;
+  int c = (unsigned char)serialIn[0];
+  serialIn.erase(0, 1);
+  return c;
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t n) {
+  serialOut.append((const char *)buf, n);
+  return n;
+}
+
+void simSerialInput(const char *text) { serialIn += text; }
+void simSerialWrite(const void *data, size_t n) { serialIn.append((const char *)data, n); }
+const char *simSerialOutput() { return serialOut.c_str(); }
+size_t simSerialOutputLen() { return serialOut.size(); }
+void simSerialClear() { serialOut.clear(); }
+void simSerialDropInput() { serialIn.clear(); }
+
+// ---------------- LCD ----------------
+
+// DDRAM HD44780 (2 линии по 40 байт); экран 20×4: строки 0/2 — линия 0, 1/3 — линия 1
+static char ddram[2][40];
+static int lcdAddr = 0;                                // Линия × 40 + позиция
+static char lcdRows[4][21];
+
+void LiquidCrystal_I2C::init() { clear(); }
+
+void LiquidCrystal_I2C::clear() {
+  memset(ddram, ' ', sizeof(ddram));
+  lcdAddr = 0;
+}
+
+void LiquidCrystal_I2C::setCursor(uint8_t col, uint8_t row) {
+  lcdAddr = (row & 1) * 40 + (row >= 2 ? 20 : 0) + col;
+}
+
+size_t LiquidCrystal_I2C::write(uint8_t c) {
+  int line = lcdAddr / 40;
+  ddram[line][lcdAddr % 40] = (char)c;
+  lcdAddr = line * 40 + (lcdAddr % 40 + 1) % 40;       // Автоинкремент в пределах линии
+  return 1;
+}
+
+const char *simLcdRow(int row) {
+  memcpy(lcdRows[row], &ddram[row & 1][row >= 2 ? 20 : 0], 20);
+  lcdRows[row][20] = 0;
+  return lcdRows[row];
+}
@@ -0,0 +1,205 @@
+// Хост-клиент протокола заданий: кадры — через Serial прошивки в sim
+// (simSerialWrite), ответы разбираются из её вывода по мере прогона.
+
+#include "jobclient.h"
+#include <string.h>
+#include "plant.h"
+
+JobClient client;
+
+static void send(uint8_t type, const void *payload, uint8_t len) {
+  uint8_t f[PROTO_MAX_FRAME];
+  simSerialWrite(f, protoEncode(f, type, payload, len));
+}
+
+void clientReset() {
+  client.jobs.clear();
+  client.helloSeen = false;
+  client.status.clear();
+  client.lastEndUs.clear();
+  client.acks = 0;
+  memset(&client.st, 0, sizeof(client.st));
+  memset(&client.rx, 0, sizeof(client.rx));
+}
+
+void clientHello() { send(MSG_HELLO_REQ, NULL, 0); }
+
+static void sendEnqueue(const ClientJob &j) {
+  MsgEnqueue m;
+  m.unit = j.unit;
+  m.liters = j.liters;
+  m.priority = j.priority;
+  m.jobId = j.id;
+  send(MSG_ENQUEUE, &m, sizeof(m));
+}
+
+uint16_t clientEnqueue(uint8_t unit, uint8_t liters, uint8_t priority) {
+  ClientJob j;
+  memset(&j, 0, sizeof(j));
+  j.id = (uint16_t)(client.jobs.size() + 1);
+  j.unit = unit;
+  j.liters = liters;
+  j.priority = priority;
+  j.phase = CJ_SENT;
+  client.jobs.push_back(j);
+  sendEnqueue(j);
+  return j.id;
+}
+
+void clientResend(uint16_t id) {
+  ClientJob &j = client.jobs[id - 1];
+  j.phase = CJ_SENT;
+  sendEnqueue(j);
+}
+
+void clientCancel(uint16_t id) {
+  MsgCancel m;
+  m.unit = client.jobs[id - 1].unit;
+  m.jobId = id;
+  send(MSG_CANCEL, &m, sizeof(m));
+}
+
+void clientStatusReq(uint8_t unit) { send(MSG_STATUS_REQ, &unit, 1); }
+
+void clientResume(uint8_t unit) { send(MSG_RESUME, &unit, 1); }
+
+const ClientJob *clientNextJob(uint8_t unit) {
+  const ClientJob *best = NULL;
+  for (const ClientJob &j : client.jobs) {
+    if (j.unit != unit || j.phase != CJ_QUEUED) continue;
+    if (!best || j.priority > best->priority || (j.priority == best->priority && j.ackOrder < best->ackOrder)) best = &j;
+  }
+  return best;
+}
+
+// Задание из кадра прошивки; неизвестное — ошибка протокола
+static ClientJob *jobById(uint16_t id) {
+  if (id == 0 || id > client.jobs.size()) {
+    client.st.protocolErrors++;
+    return NULL;
+  }
+  return &client.jobs[id - 1];
+}
+
+static void onAck(const MsgAck &a) {
+  if (a.type == MSG_RESUME) {                            // Не о задании
+    if (a.result != RES_OK) client.st.protocolErrors++;
+    return;
+  }
+  ClientJob *j = jobById(a.jobId);
+  if (!j) return;
+  if (a.type == MSG_CANCEL) {
+    if (a.result == RES_OK) j->phase = CJ_CANCELLED;     // NOT_FOUND — уже начато, дойдёт до JOB_END
+    return;
+  }
+  if (j->phase != CJ_SENT) { client.st.protocolErrors++; return; }
+  j->result = a.result;
+  j->phase = a.result == RES_OK ? CJ_QUEUED : CJ_REJECTED;
+  j->ackOrder = client.acks++;
+}
+
+static void onJobStart(const MsgJobStart &m, uint64_t nowUs) {
+  ClientJob *j = jobById(m.jobId);
+  if (!j) return;
+  if (m.unit != j->unit || m.liters != j->liters) { client.st.protocolErrors++; return; }
+  if (j->phase == CJ_RUNNING && j->resetSeen) {          // Цикл продолжен после сброса
+    j->resetSeen = false;
+    j->resumes++;
+    return;
+  }
+  if (j->phase != CJ_QUEUED && j->phase != CJ_LOST) { client.st.protocolErrors++; return; }
+  if (j->phase == CJ_QUEUED && clientNextJob(j->unit) != j) client.st.orderErrors++;  // LOST: JOB_START пропал при сбросе
+  uint64_t endUs = m.unit < client.lastEndUs.size() ? client.lastEndUs[m.unit] : 0;
+  if (endUs) {                                           // Задание ждало в очереди — сколько простояла станция
+    uint64_t gap = nowUs - endUs;
+    client.st.gaps++;
+    client.st.gapSumUs += gap;
+    if (gap > client.st.gapMaxUs) client.st.gapMaxUs = gap;
+    if (gap > client.gapLimitUs) client.st.lateGaps++;
+    client.lastEndUs[m.unit] = 0;
+  }
+  j->phase = CJ_RUNNING;
+  j->startUs = nowUs;
+  if (client.onStart) client.onStart(*j);
+}
+
+static void onJobEnd(const MsgJobEnd &m, uint64_t nowUs) {
+  ClientJob *j = jobById(m.jobId);
+  if (!j) return;
+  bool started = j->phase == CJ_RUNNING || (j->phase == CJ_LOST && m.result == JOB_ABORTED);
+  if (!started || m.unit != j->unit) { client.st.protocolErrors++; return; }
+  j->phase = CJ_ENDED;
+  j->resetSeen = false;
+  j->result = m.result;
+  j->deliveredMl = m.deliveredMl;
+  j->durationMs = m.durationMs;
+  j->endUs = nowUs;
+  if (m.unit < client.lastEndUs.size()) {                // После аварии станция ждёт RESUME — это не простой
+    client.lastEndUs[m.unit] = m.result == JOB_DONE && clientNextJob(m.unit) ? nowUs : 0;
+  }
+  if (client.onEnd) client.onEnd(*j);
+}
+
+// Прошивка перезапущена: очереди станций пропали, шедшие задания она
+// продолжит или остановит и сообщит об этом сама
+static void onReboot() {
+  client.st.reboots++;
+  for (ClientJob &j : client.jobs) {
+    if (j.phase == CJ_SENT || j.phase == CJ_QUEUED) j.phase = CJ_LOST;
+    else if (j.phase == CJ_RUNNING) j.resetSeen = true;
+  }
+}
+
+template <class Msg>
+static bool payloadAs(const ProtoParser &f, Msg &m) {
+  if (f.len != sizeof(Msg)) { client.st.protocolErrors++; return false; }
+  memcpy(&m, f.payload, sizeof(m));
+  return true;
+}
+
+static void onFrame(const ProtoParser &f, uint64_t nowUs) {
+  client.st.frames++;
+  switch (f.type) {
+    case MSG_HELLO: {
+      uint32_t bootId = client.hello.bootId;
+      if (!payloadAs(f, client.hello)) return;
+      if (client.helloSeen && client.hello.bootId != bootId) onReboot();
+      client.helloSeen = true;
+      client.status.assign(client.hello.units, MsgStatus());
+      client.lastEndUs.assign(client.hello.units, 0);
+      return;
+    }
+    case MSG_ACK: {
+      MsgAck a;
+      if (payloadAs(f, a)) onAck(a);
+      return;
+    }
+    case MSG_STATUS: {
+      MsgStatus s;
+      if (!payloadAs(f, s)) return;
+      client.st.statuses++;
+      if (s.unit < client.status.size()) client.status[s.unit] = s;
+      else client.st.protocolErrors++;
+      return;
+    }
+    case MSG_JOB_START: {
+      MsgJobStart m;
+      if (payloadAs(f, m)) onJobStart(m, nowUs);
+      return;
+    }
+    case MSG_JOB_END: {
+      MsgJobEnd m;
+      if (payloadAs(f, m)) onJobEnd(m, nowUs);
+      return;
+    }
+  }
+  client.st.protocolErrors++;
+}
+
+void clientFeed(const uint8_t *data, size_t n, uint64_t nowUs) {
+  for (size_t i = 0; i < n; i++) {
+    ProtoFeed r = protoFeed(client.rx, data[i]);
+    if (r == PROTO_FRAME) onFrame(client.rx, nowUs);
+    else if (r == PROTO_ERROR) client.st.bad++;
+  }
+}
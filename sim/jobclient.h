@@ -0,0 +1,70 @@
+#pragma once
+
+// Заместитель диспетчера дронов на хосте: задания прошивке по двоичному
+// протоколу (src/proto.h) через её Serial, разбор ответов и уведомлений.
+// Клиент сам знает правило очереди (приоритет, затем порядок постановки) и
+// сверяет с ним каждое JOB_START прошивки.
+
+#include <stdint.h>
+#include <vector>
+#include "proto.h"
+
+enum ClientPhase : uint8_t {
+  CJ_SENT,                             // ENQUEUE отправлен, ответа ещё нет
+  CJ_QUEUED,                           // ACK OK — в очереди станции
+  CJ_RUNNING,                          // JOB_START
+  CJ_ENDED,                            // JOB_END
+  CJ_REJECTED,                         // ACK с отказом (result)
+  CJ_CANCELLED,                        // ACK OK на CANCEL
+  CJ_LOST,                             // Прошивка сброшена до JOB_START — поставить заново (clientResend)
+};
+
+struct ClientJob {
+  uint16_t id;
+  uint8_t unit, liters, priority;
+  ClientPhase phase;
+  uint8_t result;                      // ProtoResult отказа или JobResult итога
+  uint32_t ackOrder;                   // Порядок постановки в очередь прошивки
+  uint32_t deliveredMl, durationMs;    // Из JOB_END
+  uint64_t startUs, endUs;             // Виртуальное время приёма JOB_START / JOB_END
+  bool resetSeen;                      // Прошивка сброшена во время задания: ждём JOB_START заново или JOB_END
+  uint8_t resumes;                     // Продолжено после сброса
+};
+
+struct ClientStats {
+  unsigned long frames;                // Верных кадров прошивки
+  unsigned long bad;                   // Длина или CRC неверны
+  unsigned long statuses;
+  unsigned long orderErrors;           // Прошивка начала не то задание, что по правилу очереди
+  unsigned long protocolErrors;        // Кадр о неизвестном задании или не в той фазе
+  unsigned long gaps;                  // JOB_END → JOB_START следующего, уже стоявшего в очереди (после аварии — не в счёт)
+  unsigned long lateGaps;              // Из них дольше gapLimitUs
+  unsigned long reboots;               // HELLO с новым boot_id
+  uint64_t gapSumUs, gapMaxUs;
+};
+
+struct JobClient {
+  std::vector<ClientJob> jobs;         // jobs[id - 1]
+  bool helloSeen;
+  MsgHello hello;
+  std::vector<MsgStatus> status;       // Последний STATUS станции
+  std::vector<uint64_t> lastEndUs;     // Последний JOB_END станции (0 — не было)
+  uint32_t acks;
+  uint64_t gapLimitUs;                 // Простой дольше — станция начала задание с опозданием
+  ClientStats st;
+  ProtoParser rx;
+  void (*onStart)(const ClientJob &j);
+  void (*onEnd)(const ClientJob &j);
+};
+
+extern JobClient client;
+
+void clientReset();
+void clientHello();
+uint16_t clientEnqueue(uint8_t unit, uint8_t liters, uint8_t priority);  // Номер задания
+void clientResend(uint16_t id);                                          // После отказа QUEUE_FULL или сброса прошивки (CJ_LOST)
+void clientCancel(uint16_t id);
+void clientStatusReq(uint8_t unit);
+void clientResume(uint8_t unit);                                         // Авария разобрана — очередь дальше
+void clientFeed(const uint8_t *data, size_t n, uint64_t nowUs);          // Вывод прошивки (текст пропускается)
+const ClientJob *clientNextJob(uint8_t unit);                            // Что прошивка должна начать следующим
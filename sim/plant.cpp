@@ -0,0 +1,183 @@
+// Модель установки: баки, помпы, клапаны, датчики перелива, расходомеры;
+// фронты датчиков и импульсы расходомеров вызывают ISR прошивки в тот же
+// момент виртуального времени.
+
+#include "plant.h"
+#include <string.h>
+#include <algorithm>
+
+#define PIN_COUNT         40
+#define MODE_OUTPUT       0x03         // Как OUTPUT в Arduino API
+#define MODE_INPUT_PULLUP 0x05
+#define EDGE_RISING       0x01
+#define EDGE_FALLING      0x02
+#define EDGE_CHANGE       0x03
+
+PlantState plant;
+
+static PlantConfig cfg;
+static int pinLevel[PIN_COUNT];
+static bool pinDriven[PIN_COUNT];              // Пин настроен выходом (до этого реле обесточены)
+static void (*pinIsr[PIN_COUNT])(void *);
+static void *pinIsrArg[PIN_COUNT];
+static int pinIsrMode[PIN_COUNT];
+
+// Фронт датчика при работающей помпе: ждём, когда реле обесточат
+struct PendingCut {
+  bool active;
+  uint64_t edgeUs;
+  double pumpedAtEdgeL;                        // Счётчик перекачки помпы на момент фронта
+};
+
+static PendingCut mixPending, dronePending;
+static double mixPumpedL, dronePumpedL;        // Всего подано помпами №1 и №2, л
+static double mixMeterUl, droneMeterUl;        // Прошло через расходомер с последнего импульса, мкл
+
+static bool relayOn(int pin) { return pinDriven[pin] && pinLevel[pin] == 0; }
+
+static void cutDone(CutoffLatency &lat, PendingCut &p, double pumpedL);
+
+void plantReset(const PlantConfig &c) {
+  cfg = c;
+  memset(&plant, 0, sizeof(plant));
+  memset(pinLevel, 0, sizeof(pinLevel));
+  memset(pinDriven, 0, sizeof(pinDriven));
+  memset(pinIsr, 0, sizeof(pinIsr));
+  plant.mixCut.minUs = plant.droneCut.minUs = UINT64_MAX;
+  mixPending.active = dronePending.active = false;
+  mixPumpedL = dronePumpedL = 0;
+  mixMeterUl = droneMeterUl = 0;
+  plantDockDrone(1e9, 1e9);
+}
+
+void plantDockDrone(double sensorL, double tankL) {
+  plant.droneL = 0;
+  plant.droneSensorL = sensorL;
+  plant.droneTankL = tankL;
+  pinLevel[PIN_DRONE_SENSOR] = 0;
+}
+
+void plantPress(int pin, bool pressed) { pinLevel[pin] = pressed ? 0 : 1; }
+
+void plantFirmwareReset() {
+  memset(pinDriven, 0, sizeof(pinDriven));
+  memset(pinIsr, 0, sizeof(pinIsr));
+  cutDone(plant.mixCut, mixPending, mixPumpedL);     // Реле обесточил сброс
+  cutDone(plant.droneCut, dronePending, dronePumpedL);
+  plant.bootUs = plant.nowUs;
+  plant.resets++;
+}
+
+bool plantPumping() { return relayOn(PIN_PUMP_MIX) || relayOn(PIN_PUMP_DRONE); }
+
+void plantPinMode(int pin, int mode) {
+  pinDriven[pin] = mode == MODE_OUTPUT;
+  if (mode == MODE_INPUT_PULLUP) pinLevel[pin] = 1;
+}
+
+int plantPinRead(int pin) { return pinLevel[pin]; }
+
+static void cutDone(CutoffLatency &lat, PendingCut &p, double pumpedL) {
+  if (!p.active) return;
+  p.active = false;
+  uint64_t us = plant.nowUs - p.edgeUs;
+  lat.events++;
+  lat.sumUs += us;
+  lat.minUs = std::min(lat.minUs, us);
+  lat.maxUs = std::max(lat.maxUs, us);
+  lat.maxAfterEdgeL = std::max(lat.maxAfterEdgeL, pumpedL - p.pumpedAtEdgeL);
+}
+
+void plantPinWrite(int pin, int level) {
+  pinLevel[pin] = level;
+  if (level == 0) return;
+  if (pin == PIN_PUMP_MIX) cutDone(plant.mixCut, mixPending, mixPumpedL);
+  if (pin == PIN_PUMP_DRONE) cutDone(plant.droneCut, dronePending, dronePumpedL);
+}
+
+void plantAttachIsr(int pin, void (*isr)(void *), void *arg, int mode) {
+  pinIsr[pin] = isr;
+  pinIsrArg[pin] = arg;
+  pinIsrMode[pin] = mode;
+}
+
+// Новый уровень датчика; на фронте — отметка для задержки и ISR прошивки
+static void sensorUpdate(int pin, bool wet, int pumpPin, PendingCut &p, double pumpedL) {
+  int level = wet ? 1 : 0;
+  if (level == pinLevel[pin]) return;
+  pinLevel[pin] = level;
+  if (level && relayOn(pumpPin)) {
+    p.active = true;
+    p.edgeUs = plant.nowUs;
+    p.pumpedAtEdgeL = pumpedL;
+  }
+  int mode = pinIsrMode[pin];
+  bool fire = mode == EDGE_CHANGE || (mode == EDGE_RISING && level) || (mode == EDGE_FALLING && !level);
+  if (pinIsr[pin] && fire) pinIsr[pin](pinIsrArg[pin]);
+}
+
+// Объём через расходомер; каждые ulPerPulse — импульс (спад) в ISR прошивки
+static void meterFlow(int pin, double &accUl, double ulPerPulse, double liters) {
+  if (ulPerPulse <= 0) return;
+  accUl += liters * 1e6;
+  while (accUl >= ulPerPulse) {
+    accUl -= ulPerPulse;
+    int mode = pinIsrMode[pin];
+    if (pinIsr[pin] && (mode == EDGE_FALLING || mode == EDGE_CHANGE)) pinIsr[pin](pinIsrArg[pin]);
+  }
+}
+
+static void physicsStep(double dt) {
+  if (relayOn(PIN_PUMP_MIX) && (relayOn(PIN_VALVE_A) || relayOn(PIN_VALVE_B))) {
+    double in = cfg.mixRateLps * dt;
+    plant.mixL += in;
+    mixPumpedL += in;
+    meterFlow(PIN_FLOW_MIX, mixMeterUl, cfg.mixMeterUlPerPulse, in);
+    if (plant.mixL > cfg.mixTankL) {                     // Перелив микс-бака
+      plant.spilledL += plant.mixL - cfg.mixTankL;
+      plant.mixL = cfg.mixTankL;
+    }
+  }
+  if (relayOn(PIN_PUMP_DRONE)) {
+    double out = std::min(cfg.droneRateLps * dt, plant.mixL);
+    plant.mixL -= out;
+    plant.droneL += out;
+    dronePumpedL += out;
+    meterFlow(PIN_FLOW_DRONE, droneMeterUl, cfg.droneMeterUlPerPulse, out);
+    if (plant.droneL > plant.droneTankL) {               // Перелив дрона
+      plant.spilledL += plant.droneL - plant.droneTankL;
+      plant.droneL = plant.droneTankL;
+    }
+  }
+}
+
+// Время (мкс) до ближайшего события при текущих реле: фронта датчика или
+// края бака. До него уровни меняются линейно — шаг можно брать крупный.
+static double untilLevel(double level, double rate, double mark) {
+  if (rate > 0 && level < mark) return (mark - level) / rate;
+  if (rate < 0 && level > mark) return (level - mark) / -rate;
+  return 1e9;
+}
+
+static double quietUs() {
+  double in = relayOn(PIN_PUMP_MIX) && (relayOn(PIN_VALVE_A) || relayOn(PIN_VALVE_B)) ? cfg.mixRateLps : 0;
+  double out = relayOn(PIN_PUMP_DRONE) && plant.mixL > 0 ? cfg.droneRateLps : 0;
+  double s = std::min({ untilLevel(plant.mixL, in - out, cfg.mixSensorL), untilLevel(plant.mixL, in - out, cfg.mixTankL),
+                        untilLevel(plant.mixL, in - out, 0), untilLevel(plant.droneL, out, plant.droneSensorL),
+                        untilLevel(plant.droneL, out, plant.droneTankL) });
+  return s * 1e6;
+}
+
+void plantAdvance(uint64_t us) {
+  while (us) {
+    uint64_t step = PLANT_SUBSTEP_US;
+    double quiet = quietUs();                            // Вдали от событий — крупный шаг, у события — мелкий
+    if (quiet > 2 * PLANT_SUBSTEP_US) step = ((uint64_t)quiet / PLANT_SUBSTEP_US - 1) * PLANT_SUBSTEP_US;
+    step = std::min(us, step);
+    physicsStep(step * 1e-6);
+    plant.nowUs += step;
+    us -= step;
+    sensorUpdate(PIN_MIX_SENSOR, plant.mixL >= cfg.mixSensorL, PIN_PUMP_MIX, mixPending, mixPumpedL);
+    sensorUpdate(PIN_DRONE_SENSOR, plant.droneL >= plant.droneSensorL, PIN_PUMP_DRONE, dronePending, dronePumpedL);
+  }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+// Модель установки для хост-сборки: виртуальные часы, микс-бак, бак дрона,
+// помпы, клапаны, датчики перелива, расходомеры, потенциометр и кнопки
+// станции 1 (пины — как в таблице STATIONS[] в src/main.cpp; расходомеры —
+// в сборке drone_sim_flow, где FLOW_MIX_PIN/FLOW_DRONE_PIN заданы).
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PLANT_SUBSTEP_US  50           // Шаг модели у фронта датчика или края бака, мкс (вдали от них — крупнее)
+
+#define PIN_MIX_SENSOR    34
+#define PIN_DRONE_SENSOR  32
+#define PIN_PUMP_MIX      25           // Реле активны LOW
+#define PIN_PUMP_DRONE    26
+#define PIN_VALVE_A       27
+#define PIN_VALVE_B       14
+#define PIN_START         19
+#define PIN_FLOW_MIX      16           // Расходомеры (импульс — спад, как у датчика Холла)
+#define PIN_FLOW_DRONE    17
+
+struct PlantConfig {
+  double mixSensorL;                   // Уровень датчика перелива микс-бака, л
+  double mixTankL;                     // Физический объём микс-бака (выше — пролив), л
+  double mixRateLps;                   // Подача помпы №1 при открытых клапанах, л/с
+  double droneRateLps;                 // Подача помпы №2, л/с
+  double mixMeterUlPerPulse;           // Реальный объём на импульс расходомера помпы №1, мкл
+  double droneMeterUlPerPulse;         // То же для помпы №2
+};
+
+// Задержка от фронта датчика перелива до обесточивания реле его помпы
+struct CutoffLatency {
+  unsigned long events;                // Фронтов при работающей помпе
+  uint64_t minUs, maxUs, sumUs;        // Фронт → реле OFF, мкс виртуального времени
+  double maxAfterEdgeL;                // Максимум, перекачанный после фронта, л
+};
+
+struct PlantState {
+  uint64_t nowUs;                      // Виртуальное время с запуска
+  uint64_t bootUs;                     // Последний сброс прошивки (от него — millis()/micros())
+  unsigned long resets;                // Сбросов прошивки (просадок питания)
+  double mixL;                         // Уровень микс-бака, л
+  double droneL;                       // Налито в текущий дрон, л
+  double droneSensorL;                 // Уровень датчика перелива дрона, л
+  double droneTankL;                   // Физический объём бака дрона, л
+  double spilledL;                     // Пролито мимо баков (оба бака), л
+  int potAdc;                          // Положение потенциометра, 0..4095
+  int potNoise;                        // Шум АЦП на каждом отсчёте, ± отсчётов
+  CutoffLatency mixCut;                // Датчик микс-бака → помпа №1
+  CutoffLatency droneCut;              // Датчик дрона → помпа №2
+  unsigned long flashWhilePumping;     // Обращений к flash при включённой помпе (кэш встал бы посреди цикла)
+};
+
+extern PlantState plant;
+
+void plantReset(const PlantConfig &cfg);
+void plantAdvance(uint64_t us);                    // Продвинуть время и физику; фронты датчиков вызывают ISR
+void plantDockDrone(double sensorL, double tankL); // Пустой дрон у станции
+void plantPress(int pin, bool pressed);            // Кнопка (INPUT_PULLUP: нажата = LOW)
+void plantFirmwareReset();                         // Сброс МК: выходы отпущены (реле обесточены), ISR сняты
+bool plantPumping();                               // Хоть одна помпа включена
+
+// Для hal_host.cpp
+int plantPinRead(int pin);
+void plantPinWrite(int pin, int level);
+void plantPinMode(int pin, int mode);
+void plantAttachIsr(int pin, void (*isr)(void *), void *arg, int mode);
+
+// Экран и Serial прошивки (реализация — hal_host.cpp)
+const char *simLcdRow(int row);                    // Строка экрана, 20 символов
+void simSerialInput(const char *text);             // Ввод в Serial прошивки
+void simSerialWrite(const void *data, size_t n);   // То же для двоичных кадров
+const char *simSerialOutput();                     // Накопленный вывод прошивки
+size_t simSerialOutputLen();                       // Его длина (в кадрах бывают нули)
+void simSerialClear();
+void simSerialDropInput();                         // Сброс МК: непрочитанный ввод UART пропал
@@ -0,0 +1,69 @@
+#pragma once
+
+// Arduino API для хост-сборки (HOST_SIM): пины, время, ШИМ, прерывания и
+// Serial идут в модель установки (sim/plant.cpp) и виртуальные часы.
+// Реализация — sim/hal_host.cpp. Только то, чем пользуется src/main.cpp.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <algorithm>
+
+#define HIGH          1
+#define LOW           0
+#define INPUT         0x01
+#define OUTPUT        0x03
+#define INPUT_PULLUP  0x05
+#define RISING        0x01
+#define FALLING       0x02
+#define CHANGE        0x03
+#define IRAM_ATTR
+// Своя секция: сброс прошивки в sim/ (просадка питания) восстанавливает ОЗУ
+// прошивки, кроме неё — как RTC-память ESP32
+#define RTC_NOINIT_ATTR __attribute__((section("rtc_noinit")))
+// Пины, к которым в модели ничего не подключено: стендовые станции src/main.cpp
+// (NUM_UNITS > 1) вешают на них датчики (всегда сухо) и выходы (в пустоту)
+#define SIM_DRY_PIN   39
+#define SIM_SINK_PIN  13
+
+using std::min;
+using std::max;
+
+template <class T, class L, class H>
+inline T constrain(T v, L lo, H hi) { return v < lo ? lo : (v > hi ? hi : v); }
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+void pinMode(int pin, int mode);
+int digitalRead(int pin);
+void digitalWrite(int pin, int level);
+int analogRead(int pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+void ledcSetup(int channel, int freq, int bits);
+void ledcAttachPin(int pin, int channel);
+void ledcWrite(int channel, int duty);
+
+inline int digitalPinToInterrupt(int pin) { return pin; }
+void attachInterruptArg(int pin, void (*isr)(void *), void *arg, int mode);
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud);
+  int available();
+  int read();
+  int availableForWrite();
+  size_t write(const uint8_t *buf, size_t n);
+};
+
+extern HardwareSerial Serial;
+
+void setup();
+void loop();
@@ -0,0 +1,17 @@
+#pragma once
+
+// LCD для хост-сборки: память DDRAM HD44780 с автоинкрементом адреса —
+// как у настоящего модуля (после 20-го символа строки 0 запись идёт в строку 2).
+// Модель читает экран так же, как оператор (simLcdRow, sim/plant.h).
+
+#include <Arduino.h>
+
+class LiquidCrystal_I2C {
+public:
+  LiquidCrystal_I2C(uint8_t addr, uint8_t cols, uint8_t rows) { (void)addr; (void)cols; (void)rows; }
+  void init();
+  void backlight() {}
+  void clear();
+  void setCursor(uint8_t col, uint8_t row);
+  size_t write(uint8_t c);
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+// I2C для хост-сборки: шина не нужна, LCD эмулируется целиком (LiquidCrystal_I2C.h)
+
+#include <Arduino.h>
+
+class TwoWire {
+public:
+  bool begin(int sda = -1, int scl = -1) { (void)sda; (void)scl; return true; }
+};
+
+extern TwoWire Wire;
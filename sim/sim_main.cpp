@@ -0,0 +1,510 @@
+// Прогон прошивки (настоящие setup()/loop(), DUAL_CORE 0) на модели установки
+// в виртуальном времени. Оператор действует как человек у станции: крутит
+// потенциометр, ждёт «liters: N» на экране, ставит пустой дрон, жмёт START и
+// ждёт «ready again». Итог — скорость прогона, точность дозирования,
+// задержка отсечки по переливу; код возврата 1 — порог точности/отсечки нарушен.
+// С -b прошивку посреди цикла сбрасывает «просадка питания»: её ОЗУ
+// возвращается к состоянию на момент включения (кроме RTC_NOINIT), установка
+// и flash остаются как были — цикл должен продолжиться с той же точностью.
+// С -j вместо оператора работает хост-диспетчер (jobclient.cpp): задания по
+// двоичному протоколу идут в очередь станции наперёд, следующее прошивка
+// начинает сама сразу после паузы; дрон меняют во время этой паузы. После
+// перелива переполненный дрон стоит у станции: хост шлёт RESUME не сразу, дрон
+// снимают ещё позже — до замены ни одно задание этой станции начаться не должно.
+// С -j и -b сброс приходится на каждое N-е задание станции 1: хост здоровается
+// заново, ставит пропавшие очереди ещё раз и узнаёт итог шедшего задания.
+// С -m расходомер помпы №1 врёт на заданный процент, с -L в микс-баке при
+// включении остаток: калибровка расходомеров (сборка drone_sim_flow) должна
+// выучить первое и не принять второе за приток — доза остаётся точной. С -D
+// расходомер помпы №2 оборван: пропажу импульсов нельзя принять за пустой бак.
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "plant.h"
+#include "jobclient.h"
+
+#define SIM_PRESS_MS        50         // Удержание START (больше антидребезга)
+#define SIM_CYCLE_LIMIT_MS  600000     // Цикл дольше — прошивка зависла
+#define SIM_DRONE_SPARE_L   5          // Запас бака обычного дрона сверх цели, л
+#define SIM_REPORT_STEPS    2000       // Шагов на вывод отчёта прошивки (команда all)
+#define SIM_LOG_LIMIT_MS    3600000    // Выгрузка журнала дольше — зависла
+#define SIM_CANCEL_EVERY    16         // -j: каждое N-е задание хост сразу же отменяет
+#define SIM_DISPATCH_SLACK_MS 15       // -j: JOB_END → JOB_START дольше RESET_WAIT_MS на столько — станция простаивала
+#define SIM_RESET_WAIT_MS   1000       // RESET_WAIT_MS прошивки
+#define SIM_RESUME_MS       3000       // -j: перелив → RESUME хоста
+#define SIM_SWAP_MS         2000       // -j: RESUME → переполненный дрон снят, поставлен следующий
+#define SIM_UL_PER_PULSE    2222       // FLOW_UL_PER_PULSE прошивки
+
+struct SimOptions {
+  unsigned long cycles;                // Сколько циклов заправки
+  unsigned long stepUs;                // Виртуальное время на один вызов loop(), мкс
+  double rateErrPct;                   // Реальная подача помп относительно MS_PER_LITER, %
+  unsigned long faultEvery;            // Каждый N-й дрон — с малым баком (перелив), 0 — никогда
+  double tolPct;                       // Допустимая ошибка дозы, %
+  int adcNoise;                        // Шум АЦП потенциометра, ± отсчётов
+  bool quiet;                          // Без отчёта прошивки
+  bool printLog;                       // Вывести выгрузку журнала заправок
+  unsigned long resetEvery;            // Каждый N-й цикл — сброс прошивки посреди заправки, 0 — никогда
+  unsigned long jobs;                  // Заданий от хоста вместо оператора, 0 — оператор
+  double meterErrPct;                  // Реальный объём на импульс расходомера помпы №1 относительно FLOW_UL_PER_PULSE, %
+  double leftoverL;                    // Остаток в микс-баке при включении, л
+  bool deadDroneMeter;                 // Расходомер помпы №2 оборван: импульсов нет
+};
+
+struct SimStats {
+  unsigned long cycles, faults, stuck, resets;
+  unsigned long jobMismatch;           // -j: итог задания не тот, что ждали от дрона
+  double sumAbsErrPct, maxAbsErrPct;
+  double sumL;                         // Налито в дроны, л
+  uint64_t sumCycleUs, maxCycleUs;     // Виртуальная длительность цикла (START → ready again)
+  uint64_t loops;                      // Вызовов loop()
+  double loopWallNs;                   // Время хоста на все loop(), нс
+};
+
+static SimOptions opt = { 1000, 1000, 0.0, 10, 2.0, 0, false, false, 0, 0, 0.0, 0.0 };
+static SimStats st;
+
+// Итог выгрузки журнала прошивки (команда log)
+struct LogCheck {
+  bool finished;
+  unsigned long lines, records, bad, nextSeq;
+  unsigned long dropped, holds;        // Из logstat: потеряно при полном кольце, раз придерживали циклы
+  double virtualS;
+};
+static uint32_t rng = 12345;
+
+static uint32_t nextRand() { rng = rng * 1664525u + 1013904223u; return rng >> 8; }
+
+// ОЗУ прошивки: Makefile переименовывает .data/.bss объекта main.o в секции
+// fw_*, компоновщик даёт их границы. RTC_NOINIT — отдельная секция rtc_noinit.
+#define FW_SECTION(name) extern char __start_##name[] __attribute__((weak)), __stop_##name[] __attribute__((weak));
+FW_SECTION(fw_data)
+FW_SECTION(fw_data_rel)
+FW_SECTION(fw_data_rel_local)
+FW_SECTION(fw_bss)
+
+struct FwSection {
+  char *start, *stop;
+  std::string powerOn;                 // Содержимое на момент включения
+};
+
+static FwSection fwRam[] = {
+  { __start_fw_data, __stop_fw_data, "" },
+  { __start_fw_data_rel, __stop_fw_data_rel, "" },
+  { __start_fw_data_rel_local, __stop_fw_data_rel_local, "" },
+  { __start_fw_bss, __stop_fw_bss, "" },
+};
+
+static void fwRamSave() {
+  for (FwSection &s : fwRam) {
+    if (s.start) s.powerOn.assign(s.start, s.stop - s.start);
+  }
+}
+
+// Просадка питания: МК сброшен, прошивка стартует заново
+static void fwReset() {
+  for (FwSection &s : fwRam) {
+    if (s.start) memcpy(s.start, s.powerOn.data(), s.powerOn.size());
+  }
+  plantFirmwareReset();
+  simSerialClear();
+  simSerialDropInput();
+  setup();
+  st.resets++;
+}
+
+// Строка экрана без хвостовых пробелов совпадает с text
+static bool lcdShows(int row, const char *text) {
+  const char *r = simLcdRow(row);
+  size_t n = strlen(text);
+  if (strncmp(r, text, n) != 0) return false;
+  for (size_t i = n; i < 20; i++) if (r[i] != ' ') return false;
+  return true;
+}
+
+// Один шаг: loop() прошивки (время хоста — в статистику), затем физика
+static void step() {
+  auto t0 = std::chrono::steady_clock::now();
+  loop();
+  st.loopWallNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+  st.loops++;
+  plantAdvance(opt.stepUs);
+}
+
+// Шаги до условия или предела виртуального времени; false — не дождались
+template <class Cond>
+static bool runUntil(Cond done, uint64_t limitUs) {
+  uint64_t until = plant.nowUs + limitUs;
+  while (!done()) {
+    if (plant.nowUs >= until) return false;
+    step();
+  }
+  return true;
+}
+
+// Потенциометр на середину ступени литров (ступени прошивки — равные доли 4096 отсчётов)
+static int potForLiters(int liters) { return ((liters - 1) * 4096 + 2048) / 100; }
+
+static void fillCycle(unsigned long n) {
+  int target = 5 + (int)(nextRand() % 96);
+  plant.potAdc = potForLiters(target);
+  char want[21];
+  snprintf(want, sizeof(want), "liters: %d", target);
+  if (!runUntil([&] { return lcdShows(1, want); }, SIM_CYCLE_LIMIT_MS * 1000ULL)) { st.stuck++; return; }
+
+  bool faultDrone = opt.faultEvery && n % opt.faultEvery == opt.faultEvery - 1;
+  double sensorL = faultDrone ? target / 2.0 : target + SIM_DRONE_SPARE_L;
+  plantDockDrone(sensorL, sensorL + 1.0);
+
+  uint64_t startUs = plant.nowUs;
+  plantPress(PIN_START, true);
+  runUntil([] { return false; }, SIM_PRESS_MS * 1000ULL);
+  plantPress(PIN_START, false);
+
+  uint64_t resetAtUs = 0;                                    // Сброс в случайный момент заправки
+  if (opt.resetEvery && n % opt.resetEvery == opt.resetEvery / 2) resetAtUs = startUs + (nextRand() % (target * 300)) * 1000ULL;
+
+  bool sawFault = false;
+  auto watch = [&] {
+    if (resetAtUs && plant.nowUs >= resetAtUs) {
+      resetAtUs = 0;
+      if (plantPumping()) fwReset();                         // Цикл уже закончился — сбрасывать нечего
+    }
+    if (lcdShows(2, "filled in") || lcdShows(2, "power lost")) sawFault = true;
+  };
+  bool ok = runUntil([&] { watch(); return !lcdShows(2, "ready again"); }, SIM_CYCLE_LIMIT_MS * 1000ULL)
+         && runUntil([&] { watch(); return lcdShows(2, "ready again"); }, SIM_CYCLE_LIMIT_MS * 1000ULL);
+  if (!ok) { st.stuck++; return; }
+
+  uint64_t us = plant.nowUs - startUs;
+  st.sumCycleUs += us;
+  if (us > st.maxCycleUs) st.maxCycleUs = us;
+  st.sumL += plant.droneL;
+  if (sawFault || faultDrone) {
+    st.faults++;
+    return;
+  }
+  double errPct = fabs(plant.droneL - target) * 100.0 / target;
+  st.cycles++;
+  st.sumAbsErrPct += errPct;
+  if (errPct > st.maxAbsErrPct) st.maxAbsErrPct = errPct;
+}
+
+// ---------------- режим -j: задания от хоста ----------------
+
+static uint16_t dockedFor;                                   // Задание, под которое стоит дрон
+static uint64_t resumeAtUs, swapAtUs;                        // Разбор аварии станции 1 (0 — не ждём)
+static uint64_t resetAtUs;                                   // -b: сброс посреди задания (0 — не ждём)
+static uint16_t resetJob;                                    // Задание, во время которого был сброс
+
+static bool jobFaultDrone(uint16_t id) { return opt.faultEvery && (id - 1) % opt.faultEvery == opt.faultEvery - 1; }
+
+static void dockFor(const ClientJob &j) {
+  double sensorL = jobFaultDrone(j.id) ? j.liters / 2.0 : j.liters + SIM_DRONE_SPARE_L;
+  plantDockDrone(sensorL, sensorL + 1.0);
+  dockedFor = j.id;
+}
+
+// Очередь была пуста — дрон ставят по уведомлению (помпа №2 пойдёт после затравки микс-бака).
+// Баки и дроны есть только у станции 1; стендовые (NUM_UNITS > 1) качают по времени.
+static void jobStarted(const ClientJob &j) {
+  if (j.unit != 0) return;
+  if (resumeAtUs || swapAtUs) st.jobMismatch++;              // Начато в переполненный дрон
+  else if (dockedFor != j.id) dockFor(j);
+  if (opt.resetEvery && j.id % opt.resetEvery == opt.resetEvery / 2) {
+    resetAtUs = plant.nowUs + (nextRand() % (j.liters * 300)) * 1000ULL;
+  }
+}
+
+// Итог задания; новый дрон — сразу, под задание, которое станция возьмёт следующим.
+// Переполненный дрон остаётся до разбора аварии (jobFaultStep).
+static void jobEnded(const ClientJob &j) {
+  if (j.unit != 0) {
+    if (j.result != JOB_DONE) st.jobMismatch++;
+    return;
+  }
+  uint64_t us = j.endUs - j.startUs;
+  st.sumCycleUs += us;
+  if (us > st.maxCycleUs) st.maxCycleUs = us;
+  st.sumL += plant.droneL;
+  bool fault = jobFaultDrone(j.id);
+  bool aborted = j.result == JOB_ABORTED && resetJob == j.id;  // Продолжить после сброса нельзя — тоже итог
+  if (j.result != (fault ? JOB_OVERFLOW : JOB_DONE) && !aborted) st.jobMismatch++;
+  if (j.result != JOB_DONE) {
+    st.faults++;
+    resumeAtUs = plant.nowUs + SIM_RESUME_MS * 1000ULL;
+    const ClientJob *next = clientNextJob(j.unit);
+    if (aborted && next) dockFor(*next);                     // Недолитый дрон датчик не держит — меняют до RESUME
+    return;
+  }
+  double errPct = fabs(plant.droneL - j.liters) * 100.0 / j.liters;
+  st.cycles++;
+  st.sumAbsErrPct += errPct;
+  if (errPct > st.maxAbsErrPct) st.maxAbsErrPct = errPct;
+  const ClientJob *next = clientNextJob(j.unit);
+  if (next) dockFor(*next);
+}
+
+// Просадка питания посреди задания: хост видит перезапуск порта и здоровается заново
+static void jobResetStep() {
+  if (!resetAtUs || plant.nowUs < resetAtUs) return;
+  resetAtUs = 0;
+  if (!plantPumping()) return;                               // Цикл уже закончился — сбрасывать нечего
+  resetJob = dockedFor;
+  fwReset();
+  clientHello();
+}
+
+// Разбор аварии: хост снимает удержание очереди, переполненный дрон меняют
+// позже — до замены станцию держит мокрый датчик
+static void jobFaultStep() {
+  if (resumeAtUs && plant.nowUs >= resumeAtUs) {
+    resumeAtUs = 0;
+    if (plantPinRead(PIN_DRONE_SENSOR)) swapAtUs = plant.nowUs + SIM_SWAP_MS * 1000ULL;
+    clientResume(0);
+  }
+  if (swapAtUs && plant.nowUs >= swapAtUs) {
+    swapAtUs = 0;
+    const ClientJob *next = clientNextJob(0);
+    if (next) dockFor(*next);
+    else plantDockDrone(1e9, 1e9);                           // Заданий нет — пустое место, датчик сухой
+  }
+}
+
+// Шаг прогона и разбор вывода прошивки клиентом (текста в нём нет — команд не шлём)
+static void jobStep() {
+  step();
+  clientFeed((const uint8_t *)simSerialOutput(), simSerialOutputLen(), plant.nowUs);
+  simSerialClear();
+}
+
+// Итог прогона -j: все задания завершены, станция в ожидании с пустой очередью
+struct JobsCheck {
+  unsigned long ended, cancelled, rejected, lost;
+  bool finalIdle;
+};
+
+static JobsCheck jobsRun() {
+  JobsCheck jc = {};
+  client.onStart = jobStarted;
+  client.onEnd = jobEnded;
+  client.gapLimitUs = (SIM_RESET_WAIT_MS + SIM_DISPATCH_SLACK_MS) * 1000ULL;
+  clientHello();
+  if (!runUntil([] { jobStep(); return client.helloSeen; }, SIM_CYCLE_LIMIT_MS * 1000ULL)) { st.stuck++; return jc; }
+
+  unsigned units = client.hello.units;
+  unsigned long sent = 0, seenFrames = ~0UL;
+  uint64_t progressUs = plant.nowUs;
+  for (;;) {
+    if (client.st.frames != seenFrames) {                    // Фазы заданий меняют только кадры прошивки
+      seenFrames = client.st.frames;
+      std::vector<unsigned> inflight(units, 0);
+      unsigned long ended = 0;
+      for (const ClientJob &j : client.jobs) {
+        inflight[j.unit] += j.phase == CJ_SENT || j.phase == CJ_QUEUED;
+        ended += j.phase == CJ_ENDED || j.phase == CJ_CANCELLED;
+      }
+      for (ClientJob &j : client.jobs) {                     // Очередь была полна — повторить, когда освободится
+        if (j.phase == CJ_REJECTED && j.result == RES_QUEUE_FULL && inflight[j.unit] < client.hello.queueLen) {
+          jc.rejected++;
+          clientResend(j.id);
+          inflight[j.unit]++;
+        } else if (j.phase == CJ_LOST) {                     // Очередь пропала при сбросе — поставить заново
+          jc.lost++;
+          clientResend(j.id);
+          inflight[j.unit]++;
+        }
+      }
+      for (; sent < opt.jobs && inflight[sent % units] < client.hello.queueLen; sent++) {  // Очереди станций (по кругу) — полные наперёд
+        uint8_t unit = (uint8_t)(sent % units);
+        uint16_t id = clientEnqueue(unit, (uint8_t)(5 + nextRand() % 96), (uint8_t)(nextRand() % 4));
+        inflight[unit]++;
+        if (id % SIM_CANCEL_EVERY == 0) clientCancel(id);
+      }
+      if (ended != jc.ended) {
+        jc.ended = ended;
+        progressUs = plant.nowUs;
+      }
+      if (ended == opt.jobs) break;
+    }
+    if (plant.nowUs - progressUs >= SIM_CYCLE_LIMIT_MS * 1000ULL) { st.stuck++; return jc; }
+    jobResetStep();
+    jobFaultStep();
+    jobStep();
+  }
+  for (const ClientJob &j : client.jobs) jc.cancelled += j.phase == CJ_CANCELLED;
+
+  // Пауза после последнего цикла (и разбор аварии) — и запрос состояния: очередь пуста, заданий нет
+  runUntil([] { jobFaultStep(); jobStep(); return false; }, (SIM_RESUME_MS + SIM_SWAP_MS) * 1000ULL);
+  unsigned long statuses = client.st.statuses;
+  clientStatusReq(PROTO_ALL_UNITS);
+  runUntil([&] { jobStep(); return client.st.statuses >= statuses + units; }, SIM_CYCLE_LIMIT_MS * 1000ULL);
+  jc.finalIdle = client.st.statuses >= statuses + units;
+  for (const MsgStatus &s : client.status) jc.finalIdle &= s.state == 0 && s.queued == 0 && s.jobId == 0 && !s.held;
+  return jc;
+}
+
+// Число после «key=» в строке; 0 — ключа нет
+static unsigned long lineValue(const std::string &line, const char *key) {
+  size_t at = line.find(key);
+  return at == std::string::npos ? 0 : strtoul(line.c_str() + at + strlen(key), NULL, 10);
+}
+
+// Команда log: строки прошивки разбираются по мере вывода, заправки не нужны
+static LogCheck dumpLog() {
+  LogCheck lc = {};
+  std::string partial;
+  simSerialClear();
+  simSerialInput("log\n");
+  uint64_t t0 = plant.nowUs;
+  while (!lc.finished && plant.nowUs - t0 < SIM_LOG_LIMIT_MS * 1000ULL) {
+    step();
+    partial += simSerialOutput();
+    simSerialClear();
+    size_t nl;
+    while ((nl = partial.find('\n')) != std::string::npos) {
+      std::string line = partial.substr(0, nl);
+      partial.erase(0, nl + 1);
+      if (opt.printLog) puts(line.c_str());
+      if (line.compare(0, 5, "fill ") == 0) lc.lines++;
+      else if (line.compare(0, 10, "log begin ") == 0) lc.nextSeq = lineValue(line, "next_seq=");
+      else if (line.compare(0, 8, "log end ") == 0) {
+        lc.records = lineValue(line, "records=");
+        lc.bad = lineValue(line, "bad=");
+        lc.finished = true;
+      }
+    }
+  }
+  lc.virtualS = (plant.nowUs - t0) * 1e-6;
+
+  simSerialInput("logstat\n");                               // Счётчики журнала: кольцо не должно было переполняться
+  bool stat = runUntil([&] {
+    partial += simSerialOutput();
+    simSerialClear();
+    size_t at = partial.find("log fs=");
+    return at != std::string::npos && partial.find('\n', at) != std::string::npos;
+  }, SIM_CYCLE_LIMIT_MS * 1000ULL);
+  if (stat) {
+    std::string line = partial.substr(partial.find("log fs="));
+    lc.dropped = lineValue(line, "dropped=");
+    lc.holds = lineValue(line, "holds=");
+  } else lc.finished = false;
+  return lc;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-n cycles] [-s step_us] [-e rate_err_pct] [-f fault_every] [-t tol_pct] [-a adc_noise] [-b reset_every] [-j jobs]\n"
+          "          [-m meter_err_pct] [-L leftover_l] [-D] [-q] [-l]\n"
+          "  -n  fill cycles to run (default 1000)\n"
+          "  -s  virtual time per loop() call, us (default 1000 = CONTROL_PERIOD_MS)\n"
+          "  -e  real pump rate vs MS_PER_LITER, %% (default 0)\n"
+          "  -f  every N-th drone has a small tank and overflows (default 10, 0 = never)\n"
+          "  -t  max allowed dose error, %% (default 2)\n"
+          "  -a  potentiometer ADC noise, +/- counts (default 0)\n"
+          "  -b  every N-th cycle, reset the firmware mid-fill (default 0 = never)\n"
+          "  -j  run N jobs from a host dispatcher over the binary protocol instead of\n"
+          "      the operator (-n is ignored; with -b, every N-th job on station 1 is reset)\n"
+          "  -m  real volume per pump 1 flow-meter pulse vs FLOW_UL_PER_PULSE, %% (default 0;\n"
+          "      meters are wired in the drone_sim_flow build only)\n"
+          "  -L  liters left in the mix tank at power-on (default 0)\n"
+          "  -D  pump 2 flow meter is dead (no pulses; drone_sim_flow)\n"
+          "  -q  skip the firmware's own 'all' report\n"
+          "  -l  print the firmware's fill log dump\n", prog);
+}
+
+int main(int argc, char **argv) {
+  int c;
+  while ((c = getopt(argc, argv, "n:s:e:f:t:a:b:j:m:L:Dqlh")) != -1) {
+    switch (c) {
+      case 'n': opt.cycles = strtoul(optarg, NULL, 10); break;
+      case 's': opt.stepUs = strtoul(optarg, NULL, 10); break;
+      case 'e': opt.rateErrPct = atof(optarg); break;
+      case 'f': opt.faultEvery = strtoul(optarg, NULL, 10); break;
+      case 't': opt.tolPct = atof(optarg); break;
+      case 'a': opt.adcNoise = atoi(optarg); break;
+      case 'q': opt.quiet = true; break;
+      case 'l': opt.printLog = true; break;
+      case 'b': opt.resetEvery = strtoul(optarg, NULL, 10); break;
+      case 'j': opt.jobs = strtoul(optarg, NULL, 10); break;
+      case 'm': opt.meterErrPct = atof(optarg); break;
+      case 'L': opt.leftoverL = atof(optarg); break;
+      case 'D': opt.deadDroneMeter = true; break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if (!opt.stepUs) opt.stepUs = 1;
+
+  double nominalLps = 1000.0 / 300.0 * (1.0 + opt.rateErrPct / 100.0);   // MS_PER_LITER = 300
+  double meterUl = SIM_UL_PER_PULSE * (1.0 + opt.meterErrPct / 100.0);
+  PlantConfig cfg = { 20.0, 22.0, nominalLps, nominalLps, meterUl, opt.deadDroneMeter ? 0.0 : SIM_UL_PER_PULSE };
+  plantReset(cfg);
+  plant.mixL = opt.leftoverL;
+  plant.potNoise = opt.adcNoise;
+
+  auto wall0 = std::chrono::steady_clock::now();
+  fwRamSave();
+  setup();
+  JobsCheck jc = {};
+  if (opt.jobs) jc = jobsRun();
+  else for (unsigned long n = 0; n < opt.cycles && st.stuck == 0; n++) fillCycle(n);
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+  double virtS = plant.nowUs * 1e-6;
+  unsigned long done = st.cycles + st.faults;
+
+  printf("sim cycles=%lu faults=%lu stuck=%lu resets=%lu wall_s=%.2f virtual_s=%.0f speedup=%.0f cycles_per_s=%.1f\n",
+         st.cycles, st.faults, st.stuck, st.resets, wallS, virtS, wallS > 0 ? virtS / wallS : 0, wallS > 0 ? done / wallS : 0);
+  double loopNs = st.loops ? st.loopWallNs / st.loops : 0;             // Цена прохода по часам хоста (micros() прошивки — виртуальное)
+  printf("loop calls=%llu avg_ns=%.0f", (unsigned long long)st.loops, loopNs);
+  if (client.helloSeen) printf(" units=%u per_unit_ns=%.0f", client.hello.units, loopNs / client.hello.units);
+  printf("\n");
+  printf("dose avg_err_pct=%.3f max_err_pct=%.3f liters=%.0f avg_cycle_s=%.2f max_cycle_s=%.2f lpm=%.1f\n",
+         st.cycles ? st.sumAbsErrPct / st.cycles : 0, st.maxAbsErrPct, st.sumL,
+         done ? st.sumCycleUs * 1e-6 / done : 0, st.maxCycleUs * 1e-6,
+         st.sumCycleUs ? st.sumL * 60e6 / st.sumCycleUs : 0);
+  const CutoffLatency *cuts[2] = { &plant.droneCut, &plant.mixCut };
+  const char *names[2] = { "drone", "mix" };
+  for (int i = 0; i < 2; i++) {
+    const CutoffLatency &l = *cuts[i];
+    printf("cutoff %s events=%lu min_us=%llu max_us=%llu avg_us=%.1f max_after_edge_ml=%.1f\n", names[i], l.events,
+           (unsigned long long)(l.events ? l.minUs : 0), (unsigned long long)l.maxUs,
+           l.events ? (double)l.sumUs / l.events : 0, l.maxAfterEdgeL * 1000.0);
+  }
+  printf("spilled_l=%.3f\n", plant.spilledL);
+
+  LogCheck lc = dumpLog();                                   // Журнал заправок: всё записанное читается обратно
+  bool logOk = lc.finished && lc.bad == 0 && lc.records == lc.lines && lc.records > 0 && lc.dropped == 0 &&
+               plant.flashWhilePumping == 0;
+
+  bool jobsOk = true;
+  if (opt.jobs) {                                            // С опозданием — лишь задания, придержанные ради flash
+    const ClientStats &cs = client.st;
+    jobsOk = jc.ended == opt.jobs && jc.finalIdle && st.jobMismatch == 0 && cs.orderErrors == 0 &&
+             cs.protocolErrors == 0 && cs.bad == 0 && cs.lateGaps <= lc.holds * client.hello.units;
+    printf("jobs ended=%lu cancelled=%lu requeued=%lu lost=%lu mismatch=%lu order_errors=%lu protocol_errors=%lu bad_frames=%lu "
+           "statuses=%lu gaps=%lu late=%lu gap_avg_ms=%.1f gap_max_ms=%.1f final=%s %s\n",
+           jc.ended, jc.cancelled, jc.rejected, jc.lost, st.jobMismatch, cs.orderErrors, cs.protocolErrors, cs.bad, cs.statuses,
+           cs.gaps, cs.lateGaps, cs.gaps ? cs.gapSumUs * 1e-3 / cs.gaps : 0, cs.gapMaxUs * 1e-3,
+           jc.finalIdle ? "idle" : "busy", jobsOk ? "ok" : "broken");
+  }
+
+  printf("log records=%lu next_seq=%lu bad=%lu dropped=%lu holds=%lu flash_pumping=%lu dump_virtual_s=%.1f %s\n", lc.records,
+         lc.nextSeq, lc.bad, lc.dropped, lc.holds, plant.flashWhilePumping, lc.virtualS, logOk ? "ok" : "broken");
+
+  if (!opt.quiet) {                                          // Собственные замеры прошивки — через её команды Serial
+    simSerialClear();
+    simSerialInput("all\n");
+    for (int i = 0; i < SIM_REPORT_STEPS; i++) step();
+    fputs(simSerialOutput(), stdout);
+  }
+
+  bool pass = logOk && jobsOk && st.stuck == 0 && st.maxAbsErrPct <= opt.tolPct && plant.droneCut.maxUs <= opt.stepUs;
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+// Аппаратный слой. Логика станции работает через Arduino API (digitalRead,
+// digitalWrite, analogRead, millis, ledcWrite, LiquidCrystal_I2C) и через
+// функции ниже — то, чего в Arduino API нет: групповая запись выходов GPIO
+// (реле, в том числе из ISR отсечки), счётчик тактов, сведения о куче,
+// файлы во flash (журнал заправок), причина сброса, случайное число.
+// Сборка для ESP32 — реализация здесь же. Хост-сборка (HOST_SIM, каталог sim/)
+// подставляет Arduino API из sim/shim, а эти функции — поверх модели установки.
+
+#include <Arduino.h>
+
+// Сведения о куче (8-битная память)
+struct HalHeapInfo {
+  uint32_t freeBytes;             // Свободно
+  uint32_t minFreeBytes;          // Минимум свободного с запуска
+  uint32_t largestBlock;          // Крупнейший свободный блок
+  uint32_t allocatedBlocks;       // Занятых блоков
+};
+
+// Набор выходов GPIO: биты пинов 0..31 (lo) и 32..39 (hi)
+struct PinMask {
+  uint32_t lo, hi;
+};
+
+constexpr PinMask pinMask(int pin) {
+  return pin < 0 ? PinMask{0, 0} : pin < 32 ? PinMask{(uint32_t)1 << pin, 0} : PinMask{0, (uint32_t)1 << (pin - 32)};
+}
+
+constexpr PinMask operator|(PinMask a, PinMask b) { return PinMask{a.lo | b.lo, a.hi | b.hi}; }
+
+#ifdef HOST_SIM
+
+void halOutHigh(PinMask m);                       // Реализация — sim/hal_host.cpp
+void halOutLow(PinMask m);
+bool halPinLevel(int pin);
+uint32_t halCycleCount();
+uint32_t halCpuMhz();
+uint32_t halHeapFree();
+void halHeapInfo(HalHeapInfo &info);
+
+bool halFsBegin();
+long halFsSize(const char *path);
+bool halFsAppend(const char *path, const void *data, size_t n);
+size_t halFsRead(const char *path, size_t offset, void *buf, size_t n);
+void halFsRemove(const char *path);
+
+const char *halResetReason();
+uint32_t halRandom();
+
+#else
+
+#include <esp_heap_caps.h>
+#include <soc/gpio_struct.h>
+#include <LittleFS.h>
+#include <esp_system.h>
+
+// Выходы группы — в HIGH / LOW одной записью в регистр «установить/сбросить
+// биты» (на банк): без чтения-модификации, пины группы в пределах банка
+// переключаются одновременно. Можно из ISR. Пины должны быть настроены OUTPUT.
+static inline void IRAM_ATTR halOutHigh(PinMask m) {
+  if (m.lo) GPIO.out_w1ts = m.lo;
+  if (m.hi) GPIO.out1_w1ts.val = m.hi;
+}
+
+static inline void IRAM_ATTR halOutLow(PinMask m) {
+  if (m.lo) GPIO.out_w1tc = m.lo;
+  if (m.hi) GPIO.out1_w1tc.val = m.hi;
+}
+
+// Уровень входа прямо из регистра — можно из ISR
+static inline bool IRAM_ATTR halPinLevel(int pin) {
+  return pin < 32 ? (GPIO.in >> pin) & 1 : (GPIO.in1.data >> (pin - 32)) & 1;
+}
+
+static inline uint32_t IRAM_ATTR halCycleCount() { return ESP.getCycleCount(); }
+
+inline uint32_t halCpuMhz() { return getCpuFrequencyMhz(); }
+
+inline uint32_t halHeapFree() { return heap_caps_get_free_size(MALLOC_CAP_8BIT); }
+
+inline void halHeapInfo(HalHeapInfo &h) {
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+  h.freeBytes = info.total_free_bytes;
+  h.minFreeBytes = info.minimum_free_bytes;
+  h.largestBlock = info.largest_free_block;
+  h.allocatedBlocks = info.allocated_blocks;
+}
+
+// Файлы во flash (LittleFS: раздел spiffs таблицы разделов). Каждый вызов
+// открывает и закрывает файл: запись доходит до flash сразу.
+
+// Смонтировать; раздел не размечен — отформатировать
+inline bool halFsBegin() { return LittleFS.begin(true); }
+
+// Размер файла, байт; -1 — файла нет
+inline long halFsSize(const char *path) {
+  if (!LittleFS.exists(path)) return -1;
+  File f = LittleFS.open(path, "r");
+  if (!f) return -1;
+  long n = (long)f.size();
+  f.close();
+  return n;
+}
+
+// Дописать в конец (файла нет — создать)
+inline bool halFsAppend(const char *path, const void *data, size_t n) {
+  File f = LittleFS.open(path, "a");
+  if (!f) return false;
+  size_t written = f.write((const uint8_t *)data, n);
+  f.close();
+  return written == n;
+}
+
+// Прочитать с позиции offset; возвращает прочитанное, байт
+inline size_t halFsRead(const char *path, size_t offset, void *buf, size_t n) {
+  if (!LittleFS.exists(path)) return 0;
+  File f = LittleFS.open(path, "r");
+  if (!f) return 0;
+  size_t got = f.seek(offset) ? f.read((uint8_t *)buf, n) : 0;
+  f.close();
+  return got;
+}
+
+inline void halFsRemove(const char *path) {
+  if (LittleFS.exists(path)) LittleFS.remove(path);
+}
+
+// Причина последнего сброса — коротким словом
+inline const char *halResetReason() {
+  switch (esp_reset_reason()) {
+    case ESP_RST_POWERON:   return "poweron";
+    case ESP_RST_BROWNOUT:  return "brownout";
+    case ESP_RST_EXT:       return "ext";
+    case ESP_RST_SW:        return "sw";
+    case ESP_RST_PANIC:     return "panic";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:       return "wdt";
+    case ESP_RST_DEEPSLEEP: return "deepsleep";
+    default:                return "other";
+  }
+}
+
+// Аппаратный генератор случайных чисел
+inline uint32_t halRandom() { return esp_random(); }
+
+#endif
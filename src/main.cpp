@@ -2,96 +2,518 @@
 #include <Wire.h>                    
 #include <LiquidCrystal_I2C.h>        
 #include <math.h>                   
+#include <atomic>
+#include "hal.h"                      // Регистры GPIO, такты, куча — ESP32 или модель (sim/)
+#include "proto.h"                    // Двоичный протокол заданий (общий с клиентом в sim/)
 
-LiquidCrystal_I2C lcd(0x27, 20, 4);   // LCD: адрес 0x27, 20 символов, 4 строки
+#define LCD_COLS 20
+#define LCD_ROWS 4
+LiquidCrystal_I2C lcd(0x27, LCD_COLS, LCD_ROWS);   // LCD: адрес 0x27, 20 символов, 4 строки
 
-#define POT_PIN         33             // Пин потенциометра (ADC вход ESP32)
+#define POT_PIN         33             // Пин общего потенциометра — для станции на экране (ADC1)
 #define START_BTN_PIN   19             // Пин кнопки старта заправки
 #define SWITCH_BTN_PIN  18             // Пин кнопки переключения станций (экранов)
+#define I2C_SDA_PIN     21             // I2C LCD
+#define I2C_SCL_PIN     22
 
-#define NUM_UNITS 1                    // Количество станций
+#ifndef NUM_UNITS
+#define NUM_UNITS 1                    // Количество станций (все обслуживаются одновременно)
+#endif
+
+// Замеры доступны по командам Serial (help — список). Период автоматического
+// вывода всех замеров (команда all) с началом нового окна, мс (0 — только по команде)
+#define BENCH_REPORT_MS 0
+
+// Управление и интерфейс — отдельные задачи FreeRTOS на разных ядрах.
+// 0 — обе части по очереди в loop() (один поток, как на одноядерных платах и в sim/).
+#ifndef DUAL_CORE
+#define DUAL_CORE          1
+#endif
+#define CONTROL_PERIOD_MS  1           // Период задачи управления (датчики → реле), мс
+#define UI_PERIOD_MS       5           // Период задачи интерфейса (LCD, RGB, Serial), мс
 
 // Кнстанты:
 #define MIX_TANK_CAPACITY 20           // Объём бака смешивания, литров (фиксированный)
 #define MS_PER_LITER      300          // Калибровка: миллисекунд на 1 литр (подстройкой добиваемся реального расхода)
 
+// Конвейерный долив: помпа №1 доливает микс-бак, пока помпа №2 качает в дрон.
+// 0 — последовательный режим (наполнить порцию → перекачать → повторить).
+#define PIPELINED_REFILL        1
+#define PIPELINE_PRIME_LITERS   5      // Затравка в микс-баке до пуска помпы №2, литров
+#define PIPELINE_REFILL_HYST_L  2      // Повторный пуск долива после снижения уровня на столько литров
+
+// Расходомеры (необязательные, по одному на помпу): импульсы считает ISR,
+// фазы завершаются по измеренному объёму. Без расходомера — по времени.
+#ifndef FLOW_MIX_PIN
+#define FLOW_MIX_PIN            -1     // Расходомер помпы №1 станции 1 (-1 — нет)
+#endif
+#ifndef FLOW_DRONE_PIN
+#define FLOW_DRONE_PIN          -1     // Расходомер помпы №2 станции 1 (-1 — нет)
+#endif
+#define FLOW_UL_PER_PULSE       2222   // Начальная калибровка, мкл/импульс (YF-S201: ~450 имп/л)
+#define FLOW_STALL_MS           1500   // Помпа включена, импульсов нет столько мс — обрыв, считаем по времени
+#define FLOW_EMPTY_MARK_L       10     // Помпа №2 встала при уровне модели ниже — микс-бак пуст, а не обрыв
+#define FLOW_CAL_MIN_PULSES     200    // Минимум импульсов для обучения калибровки расходомера
+#define FLOW_CAL_MIN_ML         1000   // Минимум объёма для обучения калибровки помпы (мс/л)
+#define FLOW_CAL_SHIFT          2      // Вес нового замера в обучении: 1/2^SHIFT
+#define FLOW_CAL_ABS_SHIFT      1      // То же для абсолютной калибровки (между отметками «пуст» и «полон»)
+#define FLOW_CAL_AGREE_PM       5      // Замер отличается от калибровки не больше, ‰ — расходомер откалиброван
+#define FLOW_CAL_TAIL_ML        500    // Перекачано в дрон после отметки «пуст» не больше — калибровка №1 ещё абсолютная
+#define FLOW_CAL_OVERFILL_PCT   110    // Калибровочный налив «до датчика»: предел по модели, % бака (запас на ошибку расходомера)
+#define LEVEL_UNKNOWN           (-1L)  // Отметка уровня для калибровки потеряна
+
+// Отсечка по датчикам перелива прямо из прерывания (реле — записью в регистр GPIO),
+// автомат станции отрабатывает событие в своём шаге. 0 — только опрос в шаге.
+#define OVERFLOW_ISR_CUTOFF     1
+#define CUTOFF_HIST_BUCKETS     12     // Гистограмма задержки фронт → реле: <250 нс, <500 нс, … ×2, последняя — остальное
+
+// Журнал заправок: двоичные записи событий цикла. Автомат кладёт их в кольцо
+// в ОЗУ, во flash (LittleFS) они уходят пачками из задачи интерфейса.
+#define LOG_RING          256          // Записей в кольце ОЗУ (степень двойки)
+#define LOG_BATCH         16           // Пачка дозаписи во flash, записей
+#define LOG_FLUSH_MS      30000        // Неполная пачка ждёт не дольше, мс
+#define LOG_SEGMENT_RECS  1024         // Записей в сегменте (24 КБ)
+#define LOG_SEGMENTS      8            // Сегментов по кругу (старейший стирается)
+#define LOG_DUMP_CHUNK    32           // Записей за одно чтение flash при выгрузке (только пока помпы стоят)
+#define LOG_CYCLE_RECS    16           // Запас кольца на станцию: столько записей даст её цикл, пока она доходит до конца
+#define LOG_HOLD_RECS     (LOG_RING - LOG_CYCLE_RECS * NUM_UNITS) // Столько ждёт дозаписи, а общего простоя помп нет — новые циклы придерживаются
+#define LOG_HOLD_MS       LOG_FLUSH_MS // Выгрузка ждёт чтения flash столько же — то же
+
+// Контрольная точка станций в RTC-памяти (переживает сброс по просадке питания,
+// но не отключение): состояние, цель, налитый объём, уровень микс-бака — на
+// каждом переходе автомата и через каждые CHECKPOINT_STEP_ML перекачки.
+// Прерванный сбросом цикл при запуске продолжается или останавливается аварией.
+#define RESUME_AFTER_RESET  1          // 0 — прерванный цикл всегда останавливать
+#define RESUME_MAX          1          // Продолжений одного цикла подряд (сбой за сбоем — авария)
+#define CHECKPOINT_STEP_ML  50         // Недоучёт после сброса — не больше, мл
+
+// Задания хоста: кадры src/proto.h по тому же Serial, что и текстовые команды.
+// Задание ставится в очередь станции (по приоритету) и стартует без оператора —
+// в том же шаге управления, в котором станция вышла из паузы после цикла.
+#define JOB_QUEUE_LEN       8          // Заданий в очереди станции
+#define JOB_REQUEST_RING    8          // Кадров хоста к задаче управления (степень двойки)
+#define JOB_NOTIFY_RING     16         // Ответов и уведомлений к Serial (степень двойки)
+#define PROTO_RX_TIMEOUT_MS 50         // Пауза посреди кадра — кадр отброшен
+
+// Вывод на LCD идёт через теневой буфер: логика пишет в память, а в I2C
+// раз в LCD_FLUSH_MS уходят только изменившиеся символы — не более
+// LCD_FLUSH_BUDGET байт LCD за шаг интерфейса, остальное — в следующих шагах.
+#define LCD_FLUSH_MS      100          // Период вывода кадра, мс
+#define LCD_FLUSH_BUDGET  8            // Байт LCD (символ или команда) за один шаг
+#define LCD_I2C_PER_BYTE  12           // Байт на шине I2C на 1 байт LCD (PCF8574, 4 бита: 2×3 посылки по 2 байта)
+
 // === Общий анод: инвертируем ШИМ (1=вкл) ===
 // Если общий катод, ставим 0 (без инверсии).
 #define COMMON_ANODE 0
 
-// Структура одной станции (все пины и состояние)
+// Пауза после завершения/аварии до разрешения нового запуска, мс
+#define RESET_WAIT_MS     1000
+// Время устойчивости кнопки для антидребезга, мс
+#define DEBOUNCE_MS       30
+
+// Задатчик литров (потенциометр): АЦП опрашивает задача интерфейса —
+// POT_OVERSAMPLE отсчётов за шаг, затем IIR-фильтр и гистерезис на границах
+// ступеней. Задача управления читает готовую устойчивую цель.
+#define POT_OVERSAMPLE    4            // Отсчётов АЦП за шаг интерфейса (среднее)
+#define POT_IIR_SHIFT     2            // Вес нового шага в фильтре: 1/2^SHIFT (~20 мс при UI_PERIOD_MS 5)
+#define POT_HYST_ADC      10           // Запас за границей ступени, отсчётов АЦП (ступень — ~41)
+#define POT_MAX_LITERS    100          // Ступени 1..POT_MAX_LITERS литров — равные доли шкалы
+#define POT_ADC_RANGE     4096         // 12 бит
+
+// Состояния конечного автомата станции
+enum UnitState : uint8_t {
+  ST_IDLE,                  // Ожидание: выбор литров потенциометром, ждём START
+  ST_FILL_MIX,              // Фаза A: наполнение микс-бака (помпа №1 + клапаны)
+  ST_PUMP_DRONE,            // Фаза B: перекачка из микс-бака в дрон (помпа №2)
+  ST_WAIT_RESET,            // Пауза перед разрешением нового запуска
+  ST_FAULT                  // Авария: перелив бака дрона (красный, затем пауза)
+};
+
+// Канал учёта расхода одной помпы: расходомер (если есть) и модель по времени.
+// Обе калибровки обучаются по ходу работы: мкл/импульс — по отметке датчика
+// перелива микс-бака, мс/л — по измеренному расходомером объёму.
+struct FlowChannel {
+  int pin;                        // Пин расходомера (-1 — нет, объём только по времени)
+  volatile uint32_t pulses;       // Импульсы с момента запуска (пишет только ISR)
+  uint32_t seenPulses;            // Импульсы, уже учтённые в объёме
+  uint32_t fracUl;                // Остаток пересчёта меньше 1 мл, мкл
+  uint32_t ulPerPulse;            // Калибровка расходомера, мкл/импульс
+  uint32_t msPerLiter;            // Калибровка помпы, мс/л
+  unsigned long runMs;            // Наработка помпы за цикл, мс
+  unsigned long lastPulseMs;      // Последний импульс (или пуск помпы) — контроль обрыва
+  unsigned long pulseRunMs;       // Наработка на момент последнего импульса
+  unsigned long segRunMs;         // Наработка на начало отрезка обучения мс/л
+  long segMl;                     // Измеренный объём на начало отрезка
+  long totalMl;                   // Объём через канал с запуска, мл
+  bool calibrated;                // Абсолютная калибровка по отметкам уровня сошлась
+  bool stalled;                   // Импульсы пропали при работающей помпе (решает integrateFlows)
+  bool failed;                    // Обрыв расходомера в этом цикле — учёт по времени
+};
+
+// Быстрая отсечка помпы по фронту датчика перелива (PNP: LOW→HIGH).
+// Пока помпа включена, отсечка «взведена»: ISR сам обесточивает реле и
+// оставляет отметки времени — автомат станции подхватит событие в шаге.
+struct OverflowCutoff {
+  int sensorPin;                  // Пин датчика перелива
+  PinMask relay;                  // Реле помпы (маска регистра выходов GPIO)
+  volatile bool armed;            // Помпа включена — ISR вправе её отключить
+  volatile bool tripped;          // ISR отключил реле; автомат ещё не отработал
+  volatile uint32_t edgeCycles;   // Вход в ISR (≈ фронт датчика), такты CPU
+  volatile uint32_t cutCycles;    // Реле обесточено, такты CPU
+  volatile unsigned long edgeUs;  // Вход в ISR, мкс (для задержки до автомата)
+};
+
+// Текст фиксированной ёмкости (строка LCD) на стеке — без обращений к куче.
+// Сборка цепочкой: TextBuf().add("mix <- ").add(liters).s
+struct TextBuf {
+  char s[LCD_COLS + 1];
+  uint8_t n;
+
+  TextBuf() : n(0) { s[0] = 0; }
+
+  TextBuf &add(const char *t) {                             // Дописать строку (лишнее отрезается)
+    while (*t && n < LCD_COLS) s[n++] = *t++;
+    s[n] = 0;
+    return *this;
+  }
+
+  TextBuf &add(long v) {                                    // Дописать целое в десятичном виде
+    char digits[12];
+    int i = 0;
+    unsigned long m = v < 0 ? 0UL - (unsigned long)v : (unsigned long)v;
+    do { digits[i++] = (char)('0' + m % 10); m /= 10; } while (m);
+    if (v < 0) digits[i++] = '-';
+    while (i && n < LCD_COLS) s[n++] = digits[--i];
+    s[n] = 0;
+    return *this;
+  }
+
+  TextBuf &add(int v) { return add((long)v); }
+};
+
+// Копирование строки в буфер фиксированного размера (с обрезкой)
+inline void textCopy(char *dst, size_t cap, const char *src) {
+  size_t i = 0;
+  while (src[i] && i + 1 < cap) { dst[i] = src[i]; i++; }
+  dst[i] = 0;
+}
+
+// Корзина гистограммы по степеням двойки: [0, first), [first, 2·first), …; последняя — всё остальное
+inline int histBucket(uint32_t v, uint32_t first, int buckets) {
+  int b = 0;
+  for (uint32_t edge = first; v >= edge && b < buckets - 1; edge <<= 1) b++;
+  return b;
+}
+
+// Фазы цикла станции (для профилирования)
+enum Phase : uint8_t {
+  PH_MIX,                   // Наполнение микс-бака (ST_FILL_MIX)
+  PH_DRONE,                 // Перекачка в дрон (ST_PUMP_DRONE)
+  PH_WAIT,                  // Пауза после цикла или аварии (ST_WAIT_RESET, ST_FAULT)
+  PH_COUNT
+};
+
+// Длительности одной фазы и чем она заканчивалась
+struct PhaseStats {
+  unsigned long count;            // Завершённых фаз
+  unsigned long lastMs;           // Последняя длительность, мс
+  unsigned long minMs;            // Минимум, мс (0 — ещё не было)
+  unsigned long maxMs;            // Максимум, мс
+  unsigned long sumMs;            // Сумма, мс
+  unsigned long bySensor;         // Завершено датчиком перелива
+  unsigned long byTimer;          // Завершено по модели объёма (время/расходомер)
+};
+
+// Профиль станции (пишет задача управления, читают команды Serial)
+struct UnitProfile {
+  PhaseStats phase[PH_COUNT];
+  unsigned long cycles;           // Завершённых циклов
+  unsigned long faults;           // Циклов, прерванных переливом дрона
+  unsigned long mixTrips;         // Срабатываний датчика микс-бака при работающей помпе №1
+  unsigned long droneTrips;       // Срабатываний датчика дрона
+  unsigned long deliveredMl;      // Перекачано в дроны, мл
+  unsigned long activeMs;         // Время циклов от START до готовности/аварии, мс
+};
+
+// Разводка одной станции. Таблица STATIONS[] — constexpr: маски групп реле
+// считаются при компиляции, конфликты пинов и каналов LEDC ловят static_assert.
+struct Station {
+  int8_t moisturePin;       // Пин датчика перелива бака дрона (PNP: HIGH=жидкость)
+  int8_t relayPin;          // Пин реле помпы №2 (перекачка из микс-бака в дрон)
+  int8_t mixMoisturePin;    // Пин датчика перелива микс-бака
+  int8_t pumpMixPin;        // Пин реле помпы №1 (наполнение микс-бака)
+  int8_t valveAPin;         // Пин клапана A (канал 95%)
+  int8_t valveBPin;         // Пин клапана B (канал 5%)
+  int8_t flowMixPin;        // Пин расходомера помпы №1 (-1 — нет)
+  int8_t flowDronePin;      // Пин расходомера помпы №2 (-1 — нет)
+  int8_t potPin;            // Свой задатчик литров, ADC1 (-1 — общий POT_PIN, когда станция на экране)
+  int8_t ledRPin, ledGPin, ledBPin; // Пины каналов R/G/B
+  int8_t ledChannel;        // Первый канал LEDC (R; G и B — следующие два)
+  PinMask pumpMixMask;      // Реле помпы №1
+  PinMask pumpDroneMask;    // Реле помпы №2
+  PinMask valvesMask;       // Оба клапана — одной записью
+
+  constexpr Station(int8_t moisture, int8_t relay, int8_t mixMoisture, int8_t pumpMix, int8_t valveA, int8_t valveB,
+                    int8_t flowMix, int8_t flowDrone, int8_t pot, int8_t ledR, int8_t ledG, int8_t ledB, int8_t ledCh)
+    : moisturePin(moisture), relayPin(relay), mixMoisturePin(mixMoisture), pumpMixPin(pumpMix),
+      valveAPin(valveA), valveBPin(valveB), flowMixPin(flowMix), flowDronePin(flowDrone), potPin(pot),
+      ledRPin(ledR), ledGPin(ledG), ledBPin(ledB), ledChannel(ledCh),
+      pumpMixMask(pinMask(pumpMix)), pumpDroneMask(pinMask(relay)), valvesMask(pinMask(valveA) | pinMask(valveB)) {}
+
+#ifdef HOST_SIM
+  // Стендовая станция хост-сборки (замер цены станции при NUM_UNITS > 1): у модели
+  // sim/ к этим пинам ничего не подключено — датчики всегда сухие, цикл идёт по времени
+  constexpr Station() : Station(SIM_DRY_PIN, SIM_SINK_PIN, SIM_DRY_PIN, SIM_SINK_PIN, SIM_SINK_PIN, SIM_SINK_PIN,
+                                -1, -1, -1, SIM_SINK_PIN, SIM_SINK_PIN, SIM_SINK_PIN, 0) {}
+#endif
+};
+
+// Разводка станций (по строке на станцию; число строк = NUM_UNITS). В хост-сборке
+// строки сверх WIRED_UNITS — стендовые, проверки разводки их не касаются.
+#ifdef HOST_SIM
+#define WIRED_UNITS   1
+#define STATION_ROWS  NUM_UNITS
+#else
+#define WIRED_UNITS   NUM_UNITS
+#define STATION_ROWS
+#endif
+
+constexpr Station STATIONS[STATION_ROWS] = {
+  //       moisture relay mixSens pumpMix valveA valveB flowMix       flowDrone       pot   R   G   B  ledCh
+  Station(   32,     26,    34,     25,     27,    14,    FLOW_MIX_PIN, FLOW_DRONE_PIN, -1,  15,  2,  4,   0 ),
+};
+
+static_assert(sizeof(STATIONS) / sizeof(STATIONS[0]) == NUM_UNITS, "STATIONS[]: число строк должно совпадать с NUM_UNITS");
+
+// --- проверки разводки при компиляции ---
+#define STATION_PIN_FIELDS 12          // Пинов в строке STATIONS[]
+#define SHARED_PIN_COUNT   5
+#define WIRED_PIN_COUNT    (WIRED_UNITS * STATION_PIN_FIELDS + SHARED_PIN_COUNT)
+#define LEDC_CHANNELS      16          // Каналов LEDC у ESP32
+
+constexpr int8_t SHARED_PINS[SHARED_PIN_COUNT] = { POT_PIN, START_BTN_PIN, SWITCH_BTN_PIN, I2C_SDA_PIN, I2C_SCL_PIN };
+
+constexpr int stationPin(const Station &s, int f) {
+  return f == 0 ? s.moisturePin : f == 1 ? s.relayPin : f == 2 ? s.mixMoisturePin : f == 3 ? s.pumpMixPin
+       : f == 4 ? s.valveAPin : f == 5 ? s.valveBPin : f == 6 ? s.flowMixPin : f == 7 ? s.flowDronePin
+       : f == 8 ? s.potPin : f == 9 ? s.ledRPin : f == 10 ? s.ledGPin : s.ledBPin;
+}
+
+// k-й занятый пин: сначала все станции, затем общие
+constexpr int wiredPin(int k) {
+  return k < WIRED_UNITS * STATION_PIN_FIELDS ? stationPin(STATIONS[k / STATION_PIN_FIELDS], k % STATION_PIN_FIELDS)
+                                              : SHARED_PINS[k - WIRED_UNITS * STATION_PIN_FIELDS];
+}
+
+constexpr bool pinUnusedAfter(int k, int j) {
+  return j >= WIRED_PIN_COUNT || ((wiredPin(k) < 0 || wiredPin(k) != wiredPin(j)) && pinUnusedAfter(k, j + 1));
+}
+
+constexpr bool pinsDistinct(int k) {
+  return k >= WIRED_PIN_COUNT || (pinUnusedAfter(k, k + 1) && pinsDistinct(k + 1));
+}
+
+// Занятые платой: GPIO 1/3 — UART0 (Serial: команды и протокол заданий),
+// GPIO 6..11 — SPI-flash модуля (прошивка и LittleFS)
+constexpr bool reservedPin(int pin) { return pin == 1 || pin == 3 || (pin >= 6 && pin <= 11); }
+
+constexpr bool pinsFree(int k) {
+  return k >= WIRED_PIN_COUNT || (!reservedPin(wiredPin(k)) && pinsFree(k + 1));
+}
+
+// GPIO 34..39 у ESP32 — только входы
+constexpr bool outputPin(int pin) { return pin >= 0 && pin < 34 && !reservedPin(pin); }
+
+constexpr bool outputsOk(int i) {
+  return i >= WIRED_UNITS || (outputPin(STATIONS[i].relayPin) && outputPin(STATIONS[i].pumpMixPin)
+                            && outputPin(STATIONS[i].valveAPin) && outputPin(STATIONS[i].valveBPin)
+                            && outputPin(STATIONS[i].ledRPin) && outputPin(STATIONS[i].ledGPin)
+                            && outputPin(STATIONS[i].ledBPin) && outputsOk(i + 1));
+}
+
+// Задатчики — только на ADC1 (GPIO 32..39): ADC2 занят при работе Wi-Fi
+constexpr bool adc1Pin(int pin) { return pin >= 32 && pin <= 39; }
+
+constexpr bool potsOk(int i) {
+  return i >= WIRED_UNITS || ((STATIONS[i].potPin < 0 || adc1Pin(STATIONS[i].potPin)) && potsOk(i + 1));
+}
+
+constexpr bool ledcApart(int i, int j) {
+  return j >= WIRED_UNITS || ((STATIONS[i].ledChannel + 3 <= STATIONS[j].ledChannel
+                             || STATIONS[j].ledChannel + 3 <= STATIONS[i].ledChannel) && ledcApart(i, j + 1));
+}
+
+constexpr bool ledcOk(int i) {
+  return i >= WIRED_UNITS || (STATIONS[i].ledChannel >= 0 && STATIONS[i].ledChannel + 3 <= LEDC_CHANNELS
+                            && ledcApart(i, i + 1) && ledcOk(i + 1));
+}
+
+static_assert(pinsDistinct(0), "разводка: один пин назначен дважды (STATIONS[] или общие пины)");
+static_assert(pinsFree(0), "разводка: GPIO 1/3 (UART0) и 6..11 (SPI-flash) заняты платой");
+static_assert(outputsOk(0), "разводка: реле и RGB — только на пинах-выходах (GPIO 34..39 — только вход, 1/3 и 6..11 заняты)");
+static_assert(adc1Pin(POT_PIN) && potsOk(0), "разводка: задатчики литров — только на ADC1 (GPIO 32..39)");
+static_assert(ledcOk(0), "разводка: каналы LEDC станций пересекаются или выходят за 16 (нужно 3 на станцию)");
+
+// Структура одной станции (разводка — в STATIONS[], здесь только состояние)
 struct Unit {
+  const Station *io;        // Разводка станции (STATIONS[i])
+
   // --- базовая логика ---
-  int moisturePin;          // Пин датчика перелива бака дрона (PNP: HIGH=жидкость)
-  int relayPin;             // Пин реле помпы №2 (перекачка из микс-бака в дрон)
   int targetLiters;         // Сколько литров нужно заправить в дрон
   int currentLiters;        // Текущее отображаемое значение (для обратного отсчёта на дисплее)
-  int lastDisplayedLiters;  // Последнее показанное значение
-  bool pumpRunning;         // Флаг: сейчас идёт перекачка в дрон
-  bool readyToStart;        // Флаг: система готова начать новый цикл
-  bool waitBeforeReset;     // Флаг: пауза перед новой заправкой (стабилизация)
-  unsigned long waitStartTime;  // Время начала паузы
-  unsigned long pumpStopTime;   // Время остановки текущей фазы
-  bool needsDisplayUpdate;      // Принудительное обновление экрана
-
-  // --- узел смешивания ---
-  int mixMoisturePin;       // Пин датчика перелива микс-бака
-  int pumpMixPin;           // Пин реле помпы №1 (наполнение микс-бака)
-  int valveAPin;            // Пин клапана A (канал 95%)
-  int valveBPin;            // Пин клапана B (канал 5%)
-
-  bool fillingMix;          // Флаг: идёт наполнение микс-бака
-  int deliveredLiters;      // Сколько уже перекачано в дрон суммарно
+  UnitState state;          // Текущее состояние автомата
+  unsigned long stateSince;     // Момент входа в текущее состояние
+
   int batchLiters;          // Объём текущей порции (<= MIX_TANK_CAPACITY)
 
   // --- строки дисплея ---
-  String statusLine2;       // Запомненный текст 2-й строки LCD
-  String statusLine3;       // Запомненный текст 3-й строки LCD
+  char statusLine2[LCD_COLS + 1]; // Запомненный текст 2-й строки LCD
+  char statusLine3[LCD_COLS + 1]; // Запомненный текст 3-й строки LCD
 
   // --- RGB индикация для станции ---
-  int ledRPin, ledGPin, ledBPin;  // Пины каналов R/G/B
-  int ledChR, ledChG, ledChB;     // Номера PWM-каналов LEDC (ESP32)
   float lastProgress01;           // Последний прогресс [0..1] (для установки цвета)
+  uint8_t ledMode;                // Что показывает диод (LedMode); ШИМ пишет задача интерфейса
+
+  // --- модель объёмов (инициализируются в setupUnitIO) ---
+  bool mixPumpOn;                 // Помпа №1 включена
+  bool dronePumpOn;               // Помпа №2 включена
+  long mixLevelMl;                // Уровень микс-бака по модели, мл
+  long deliveredMl;               // Сколько уже перекачано в дрон за цикл, мл
+  long fillGoalMl;                // Уровень, до которого наполняем бак в фазе A, мл
+  FlowChannel mixFlow;            // Учёт расхода помпы №1
+  FlowChannel droneFlow;          // Учёт расхода помпы №2
+  OverflowCutoff mixCut;          // Отсечка помпы №1 по датчику микс-бака
+  OverflowCutoff droneCut;        // Отсечка помпы №2 по датчику дрона
+  unsigned long lastModelMs;      // Момент последнего шага модели
+  long calLevel0Ml;               // Последняя отметка уровня микс-бака (пуст/полон), LEVEL_UNKNOWN — не было
+  uint32_t calInPulses0;          // Импульсы помпы №1 в момент известного уровня
+  uint32_t calOutPulses0;         // Импульсы помпы №2 в тот же момент
+  long calIn0Ml;                  // Приток через помпу №1 к тому моменту, мл
+  long calOut0Ml;                 // Расход в дрон к тому моменту, мл
+  unsigned long cycleStart;       // Момент START текущего цикла
+  unsigned long cycMixMs;         // Фазы A текущего цикла, мс (для журнала)
+  unsigned long cycDroneMs;       // Фазы B текущего цикла, мс
+  int lastRateLpm10;              // Производительность последнего цикла, л/мин ×10
+  bool endBySensor;               // Текущую фазу завершил датчик перелива (для профиля)
+  uint8_t resumes;                // Продолжений текущего цикла после сброса
+  uint16_t jobId;                 // Задание хоста текущего цикла (0 — цикл с кнопки)
+  bool jobsHeld;                  // После аварии очередь стоит до RESUME хоста или START у станции
+  UnitProfile prof;               // Длительности фаз и счётчики станции
 };
 
-// Инициализация массива станций
-Unit units[NUM_UNITS] = {
-  // moisture relay tgt cur last pRun ready wait wStart stop upd  mixSens pumpMix valveA valveB  fillMix deliv batch s2  s3   R   G   B   chR chG chB lastP
-  {   32,     26,   0,  0,  -1, false, true, false, 0,   0,  true,   34,    25,    27,    14,   false,   0,   0,  "",  "",  15,  2,  4,   -1, -1, -1, 0.0f }
+Unit units[NUM_UNITS];               // Состояние станций (заполняет setupUnitIO)
+
+volatile int currentUnit = 0;        // Индекс станции, показанной на LCD (пишет задача управления)
+
+// ---------------- LCD ----------------
+
+char lcdFrame[LCD_ROWS][LCD_COLS];   // Кадр: что должно быть на экране
+char lcdShadow[LCD_ROWS][LCD_COLS];  // Что уже выведено на экран
+int lcdCurRow = -1, lcdCurCol = -1;  // Известная позиция курсора LCD (-1 — неизвестна)
+bool lcdFlushing = false;            // Идёт вывод кадра (частями по шагам интерфейса)
+unsigned long lcdFrameStart = 0;     // Начало текущего периода вывода
 
+// Счётчики вывода на LCD (для замера нагрузки на I2C и цикл)
+struct LcdStats {
+  unsigned long frames;              // Выведенных кадров (с изменениями)
+  unsigned long lcdBytes;            // Всего байт LCD (символы + установки курсора)
+  unsigned long slices;              // Частей вывода (вызовов с передачей)
+  unsigned long lastSliceUs;         // Длительность последней части, мкс
+  unsigned long maxSliceUs;          // Максимальная часть, мкс
+  unsigned long frameUs;             // Суммарное время вывода последнего кадра, мкс
+  unsigned long i2cBytesPerSec;      // Байт I2C в секунду (за последнюю секунду)
+  unsigned long windowBytes;         // Байт LCD в текущем секундном окне
+  unsigned long windowStart;         // Начало окна, мс
 };
 
-int currentUnit = 0;                 // Индекс активной станции
+LcdStats lcdStats = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+unsigned long lcdFrameAccUs = 0;     // Накопитель времени текущего кадра
+unsigned long lcdFrameBytes = 0;     // Байт LCD в текущем кадре
 
-// ---------------- LCD ----------------
+// Функция печати строки с принудительной «очисткой» до конца строки (в кадр)
+void lcdPrintClear(uint8_t col, uint8_t row, const char *text) {
+  const char *p = text;
+  for (uint8_t c = col; c < LCD_COLS; c++) {
+    lcdFrame[row][c] = *p ? *p++ : ' ';                     // Текст, остаток строки — пробелы
+  }
+}
 
-// Функция печати строки с принудительной «очисткой» до конца строки
-void lcdPrintClear(uint8_t col, uint8_t row, const String &text) {
-  lcd.setCursor(col, row);          // Ставим курсор в нужную колонку/строку
-  lcd.print("                    "); // 20 пробелов — очищаем строку целиком
-  lcd.setCursor(col, row);          // Возвращаем курсор в начало строки
-  lcd.print(text);                  // Печатаем текст
+// Передача изменившихся символов кадра на LCD, не более budget байт LCD.
+// Курсор ставится только при разрыве: соседние символы идут подряд
+// (автоинкремент), промежуток в 1 символ дешевле переписать, чем setCursor.
+// Возвращает true, когда кадр выведен целиком.
+bool lcdFlushSlice(int budget) {
+  unsigned long t0 = micros();
+  int sent = 0;
+  bool done = true;
+  for (int r = 0; r < LCD_ROWS && done; r++) {
+    for (int c = 0; c < LCD_COLS; c++) {
+      if (lcdFrame[r][c] == lcdShadow[r][c]) continue;
+      if (sent >= budget) { done = false; break; }
+      if (lcdCurRow == r && lcdCurCol == c - 1 && c >= 1) {  // Разрыв в 1 символ — переписываем его
+        lcd.write((uint8_t)lcdFrame[r][c - 1]);
+        lcdShadow[r][c - 1] = lcdFrame[r][c - 1];
+        sent++;
+      } else if (lcdCurRow != r || lcdCurCol != c) {
+        lcd.setCursor(c, r);
+        sent++;
+      }
+      lcd.write((uint8_t)lcdFrame[r][c]);
+      lcdShadow[r][c] = lcdFrame[r][c];
+      sent++;
+      lcdCurRow = r;
+      lcdCurCol = c + 1;                                    // После символа курсор сдвигается сам
+      if (lcdCurCol >= LCD_COLS) lcdCurRow = -1;            // Переход строки у HD44780 не подряд
+    }
+  }
+  if (sent) {
+    unsigned long us = micros() - t0;
+    lcdStats.slices++;
+    lcdStats.lcdBytes += sent;
+    lcdStats.windowBytes += sent;
+    lcdStats.lastSliceUs = us;
+    if (us > lcdStats.maxSliceUs) lcdStats.maxSliceUs = us;
+    lcdFrameAccUs += us;
+    lcdFrameBytes += sent;
+  }
+  return done;
 }
 
-// Функция обновления строкт состояния и сохранения её значение
-void updateStatusLine(Unit &u, uint8_t row, const String &text) {
-  if (row == 2) u.statusLine2 = text;               //  текст 2-й строки
-  if (row == 3) u.statusLine3 = text;               //  текст 3-й строки
-  if (&u == &units[currentUnit]) {                  
-    lcdPrintClear(0, row, text);                    
+// Вывод кадра по расписанию: раз в LCD_FLUSH_MS начинается кадр и
+// передаётся порциями по LCD_FLUSH_BUDGET в каждом шаге интерфейса до завершения.
+void lcdService(unsigned long now) {
+  if (!lcdFlushing && now - lcdFrameStart >= LCD_FLUSH_MS) {
+    lcdFrameStart = now;
+    lcdFlushing = true;
+    lcdFrameAccUs = 0;
+    lcdFrameBytes = 0;
   }
+  if (lcdFlushing && lcdFlushSlice(LCD_FLUSH_BUDGET)) {
+    lcdFlushing = false;
+    if (lcdFrameBytes) {
+      lcdStats.frames++;
+      lcdStats.frameUs = lcdFrameAccUs;
+    }
+  }
+  if (now - lcdStats.windowStart >= 1000) {                 // Байт I2C в секунду
+    lcdStats.i2cBytesPerSec = lcdStats.windowBytes * LCD_I2C_PER_BYTE * 1000UL / (now - lcdStats.windowStart);
+    lcdStats.windowBytes = 0;
+    lcdStats.windowStart = now;
+  }
+}
+
+// Кадр и тень — пустой экран (сразу после lcd.clear())
+void lcdFrameReset() {
+  memset(lcdFrame, ' ', sizeof(lcdFrame));
+  memset(lcdShadow, ' ', sizeof(lcdShadow));
+  lcdCurRow = lcdCurCol = -1;
 }
 
-// Полное «восстановление» экрана станции (при переключении окна)
-void refreshDisplayForUnit(Unit &u) {
-  lcd.clear();                                      // Очищаем весь экран
-  lcd.setCursor(0, 0);                              // Заголовок
-  lcd.print("station ");
-  lcd.print(currentUnit + 1);
-  lcdPrintClear(0, 1, "liters: " + String(u.targetLiters)); // Строка 1 — целевые литры
-  if (u.statusLine2 != "") lcdPrintClear(0, 2, u.statusLine2); 
-  if (u.statusLine3 != "") lcdPrintClear(0, 3, u.statusLine3); 
-  u.needsDisplayUpdate = false;                    
+// Функция обновления строки состояния: только запоминает текст станции.
+// На экран строки попадают из снимка (задача интерфейса, renderUnit()).
+void updateStatusLine(Unit &u, uint8_t row, const char *text) {
+  if (row == 2) textCopy(u.statusLine2, sizeof(u.statusLine2), text); //  текст 2-й строки
+  if (row == 3) textCopy(u.statusLine3, sizeof(u.statusLine3), text); //  текст 3-й строки
 }
 
 // ---------------- RGB (ESP32 PWM) ----------------
@@ -103,21 +525,29 @@ static inline int inv(int v){ return constrain(255 - constrain(v,0,255), 0, 255)
 // Установка RGB-яркости (0..255 на канал), с учётом инверсии для общего анода.
 void ledWriteRGB(const Unit &u, int r, int g, int b) {
 #if COMMON_ANODE
-  ledcWrite(u.ledChR, inv(r));      // Пишем инвертированное значение на канал R
-  ledcWrite(u.ledChG, inv(g));      // Пишем инвертированное значение на канал G
-  ledcWrite(u.ledChB, inv(b));      // Пишем инвертированное значение на канал B
+  ledcWrite(u.io->ledChannel + 0, inv(r));      // Пишем инвертированное значение на канал R
+  ledcWrite(u.io->ledChannel + 1, inv(g));      // Пишем инвертированное значение на канал G
+  ledcWrite(u.io->ledChannel + 2, inv(b));      // Пишем инвертированное значение на канал B
 #else
-  ledcWrite(u.ledChR, constrain(r, 0, 255));  // Без инверсии (общий катод)
-  ledcWrite(u.ledChG, constrain(g, 0, 255));
-  ledcWrite(u.ledChB, constrain(b, 0, 255));
+  ledcWrite(u.io->ledChannel + 0, constrain(r, 0, 255));  // Без инверсии (общий катод)
+  ledcWrite(u.io->ledChannel + 1, constrain(g, 0, 255));
+  ledcWrite(u.io->ledChannel + 2, constrain(b, 0, 255));
 #endif
 }
 
+// Режим диода. Автомат станции только выбирает режим — float-математика
+// градиента и запись в LEDC выполняются в задаче интерфейса (ledApply()).
+enum LedMode : uint8_t {
+  LED_OFF,                  // Выключен
+  LED_GRADIENT,             // Цвет по прогрессу lastProgress01
+  LED_RED                   // Авария
+};
+
 // Быстрое выключение RGB
-void ledOff(const Unit &u) { ledWriteRGB(u, 0, 0, 0); }
+void ledOff(Unit &u) { u.ledMode = LED_OFF; }
 
 // Мгновенный «красный» (для аварии)
-void ledRed(const Unit &u) { ledWriteRGB(u, 255, 0, 0); }
+void ledRed(Unit &u) { u.ledMode = LED_RED; }
 
 // Простой градиент
 static inline float lerp(float a, float b, float t){ return a + (b - a) * t; }
@@ -146,51 +576,578 @@ void colorFromProgress(float p, int &r, int &g, int &b) {
 
 void ledUpdateGradient(Unit &u, float progress01) {
   u.lastProgress01 = constrain(progress01, 0.0f, 1.0f);
-  int r,g,b; colorFromProgress(u.lastProgress01, r, g, b);
-  ledWriteRGB(u, r, g, b);                              
+  u.ledMode = LED_GRADIENT;
 }
 
 // ---------------- buttons ----------------
 
+// Кнопка с неблокирующим антидребезгом (без delay и циклов ожидания)
+struct Button {
+  int pin;                  // Пин кнопки (INPUT_PULLUP: LOW=нажата)
+  bool stable;              // Устойчивое (отфильтрованное) состояние
+  bool lastRaw;             // Последнее «сырое» чтение
+  unsigned long changedAt;  // Момент последнего изменения сырого сигнала
+};
+
+Button startBtn  = { START_BTN_PIN,  HIGH, HIGH, 0 };
+Button switchBtn = { SWITCH_BTN_PIN, HIGH, HIGH, 0 };
+bool startHeld = false;              // START нажат, пока новые циклы придержаны (flashHold)
+
+// Опрос кнопки: true ровно один раз — в момент устойчивого нажатия (HIGH→LOW).
+// Удержание кнопки не блокирует цикл: повторного срабатывания нет до отпускания.
+bool buttonPressed(Button &b, unsigned long now) {
+  bool raw = digitalRead(b.pin);
+  if (raw != b.lastRaw) {                               // Сигнал изменился — перезапуск окна
+    b.lastRaw = raw;
+    b.changedAt = now;
+    return false;
+  }
+  if (raw != b.stable && now - b.changedAt >= DEBOUNCE_MS) { // Держится дольше окна — принимаем
+    b.stable = raw;
+    return b.stable == LOW;
+  }
+  return false;
+}
+
 // Обработка переключения активной станции
-void handleUnitSwitch() {
-  static bool lastState = HIGH;                         
-  bool currentState = digitalRead(SWITCH_BTN_PIN);     
-  if (lastState == HIGH && currentState == LOW) {      
-    currentUnit = (currentUnit + 1) % NUM_UNITS;        // Перейти к следующей станции по кругу
-    refreshDisplayForUnit(units[currentUnit]);          // Восстановить экран активной станции
+void handleUnitSwitch(unsigned long now) {
+  if (buttonPressed(switchBtn, now)) {
+    currentUnit = (currentUnit + 1) % NUM_UNITS;        // Перейти к следующей станции по кругу (кадр — из её снимка)
+  }
+}
+
+// ---------------- задатчик литров ----------------
+
+// Вход задатчика: фильтр АЦП и устойчивая ступень литров
+struct PotInput {
+  int pin;                  // Пин АЦП (-1 — нет)
+  int32_t filt;             // IIR-фильтр, отсчёты АЦП × 16
+  int raw;                  // Среднее последнего опроса
+  unsigned long sampleUs;   // Длительность опроса, мкс
+  volatile int liters;      // Устойчивая цель (0 — ещё не опрошен); читает задача управления
+};
+
+PotInput sharedPot;                  // Общий POT_PIN — для станции на экране
+PotInput stationPots[NUM_UNITS];     // Свои задатчики станций (STATIONS[i].potPin)
+
+// Ступень литров по АЦП
+int potStep(int adc) {
+  int l = 1 + adc * POT_MAX_LITERS / POT_ADC_RANGE;
+  return l > POT_MAX_LITERS ? POT_MAX_LITERS : l;
+}
+
+// АЦП ушёл за ступень liters дальше чем на POT_HYST_ADC — шум у границы ступень не меняет
+bool potBeyond(int adc, int liters) {
+  int lo = (liters - 1) * POT_ADC_RANGE / POT_MAX_LITERS;
+  int hi = liters * POT_ADC_RANGE / POT_MAX_LITERS;
+  return adc < lo - POT_HYST_ADC || adc >= hi + POT_HYST_ADC;
+}
+
+// Опрос входа (задача интерфейса): среднее по POT_OVERSAMPLE, фильтр, гистерезис
+void potSample(PotInput &p) {
+  if (p.pin < 0) return;
+  unsigned long t0 = micros();
+  int32_t sum = 0;
+  for (int i = 0; i < POT_OVERSAMPLE; i++) sum += analogRead(p.pin);
+  p.raw = sum / POT_OVERSAMPLE;
+  int32_t x = (int32_t)p.raw << 4;
+  if (p.liters == 0) p.filt = x;                        // Первый опрос — без разгона фильтра
+  else p.filt += (x - p.filt) >> POT_IIR_SHIFT;
+  int adc = (p.filt + 8) >> 4;
+  if (p.liters == 0 || potBeyond(adc, p.liters)) p.liters = potStep(adc);
+  p.sampleUs = micros() - t0;
+}
+
+void potService() {
+  potSample(sharedPot);
+  for (int i = 0; i < NUM_UNITS; i++) potSample(stationPots[i]);
+}
+
+void setupPots() {
+  sharedPot.pin = POT_PIN;
+  pinMode(POT_PIN, INPUT);
+  for (int i = 0; i < NUM_UNITS; i++) {
+    stationPots[i].pin = STATIONS[i].potPin;
+    if (stationPots[i].pin >= 0) pinMode(stationPots[i].pin, INPUT);
+  }
+  potService();                                         // Цели готовы до первого шага управления
+}
+
+// Цель станции по задатчику: свой вход, иначе общий, если станция на экране; 0 — задатчика нет
+int potSetpoint(int idx) {
+  if (stationPots[idx].pin >= 0) return stationPots[idx].liters;
+  return idx == currentUnit ? sharedPot.liters : 0;
+}
+
+// ----------- Учёт расхода -----------
+
+// ISR расходомера: только инкремент счётчика канала
+void IRAM_ATTR flowPulseIsr(void *arg) {
+  ((FlowChannel *)arg)->pulses++;
+}
+
+// Начало отрезка работы помпы: сброс контроля обрыва, отметка для обучения мс/л
+void flowSegmentStart(FlowChannel &f, unsigned long now) {
+  f.lastPulseMs = now;
+  f.pulseRunMs = f.runMs;
+  f.segRunMs = f.runMs;
+  f.segMl = f.totalMl;
+}
+
+// Конец отрезка: если объём измерен расходомером — уточняем мс/л помпы
+void flowSegmentEnd(FlowChannel &f) {
+  if (f.pin < 0 || f.failed) return;
+  long ml = f.totalMl - f.segMl;
+  if (ml < FLOW_CAL_MIN_ML) return;
+  long measured = (long)((unsigned long long)(f.pulseRunMs - f.segRunMs) * 1000ULL / ml); // Без «сухого» хвоста
+  f.msPerLiter += (measured - (long)f.msPerLiter) >> FLOW_CAL_SHIFT;
+}
+
+// Объём за шаг: по импульсам расходомера либо по времени работы помпы.
+// Время работы копится целиком, а объём берётся как разность пересчётов —
+// так при проходах в доли миллисекунды не теряются остатки от деления.
+long flowStepMl(FlowChannel &f, bool pumpOn, unsigned long dt, unsigned long now) {
+  long timeMl = 0;
+  if (pumpOn) {
+    long before = (long)((unsigned long long)f.runMs * 1000ULL / f.msPerLiter);
+    f.runMs += dt;
+    timeMl = (long)((unsigned long long)f.runMs * 1000ULL / f.msPerLiter) - before;
+  }
+  long ml = timeMl;
+  if (f.pin >= 0 && !f.failed) {
+    uint32_t p = f.pulses;
+    uint32_t dp = p - f.seenPulses;
+    f.seenPulses = p;
+    if (dp) {
+      f.lastPulseMs = now;
+      f.pulseRunMs = f.runMs;
+    } else if (pumpOn && now - f.lastPulseMs >= FLOW_STALL_MS) {
+      f.stalled = true;                                              // Помпа работает, импульсов нет
+    }
+    uint32_t ul = dp * f.ulPerPulse + f.fracUl;                      // Выбег после останова помпы тоже учитываем
+    f.fracUl = ul % 1000;
+    ml = (long)(ul / 1000);
+  }
+  f.totalMl += ml;
+  return ml;
+}
+
+// Обрыв расходомера: дальше объём по времени. Окно FLOW_STALL_MS без
+// импульсов помпа работала — его объём по модели, иначе он пропал бы.
+long flowFail(FlowChannel &f) {
+  f.failed = true;
+  long ml = (long)((unsigned long long)(f.runMs - f.pulseRunMs) * 1000ULL / f.msPerLiter);
+  f.totalMl += ml;
+  return ml;
+}
+
+// ----------- Быстрая отсечка перелива -----------
+
+// Задержка отсечки по всем событиям (пишет задача управления)
+struct CutoffStats {
+  unsigned long events;                       // Отсечек из ISR
+  unsigned long polled;                       // Переливов, замеченных только опросом (без фронта при взведённой отсечке)
+  uint32_t minNs;                             // Фронт → реле, минимум, нс
+  uint32_t maxNs;                             // Фронт → реле, максимум, нс
+  unsigned long hist[CUTOFF_HIST_BUCKETS];    // Гистограмма фронт → реле
+  unsigned long ackMaxUs;                     // Фронт → отработка автоматом, максимум, мкс
+};
+
+CutoffStats cutoffStats = { 0, 0, UINT32_MAX, 0, {0}, 0 };
+
+// ISR датчика перелива: подтвердить уровень (отсев иголок) и обесточить
+// реле записью в регистр «установить биты» — без digitalWrite и блокировок.
+// Задержка от фронта до входа в ISR программно не видна (единицы мкс).
+void IRAM_ATTR overflowIsr(void *arg) {
+  OverflowCutoff *c = (OverflowCutoff *)arg;
+  uint32_t edge = halCycleCount();
+  if (!c->armed) return;
+  if (!halPinLevel(c->sensorPin)) return;
+  halOutHigh(c->relay);                                      // Реле активны LOW: HIGH = обесточено
+  c->cutCycles = halCycleCount();
+  c->edgeCycles = edge;
+  c->edgeUs = micros();
+  c->armed = false;
+  c->tripped = true;
+}
+
+void setupOverflowCutoff(OverflowCutoff &c, int sensorPin, PinMask relay) {
+  c.sensorPin = sensorPin;
+  c.relay = relay;
+  c.armed = false;
+  c.tripped = false;
+#if OVERFLOW_ISR_CUTOFF
+  attachInterruptArg(digitalPinToInterrupt(sensorPin), overflowIsr, &c, RISING);
+#endif
+}
+
+// Опрос датчика в шаге автомата. Отсечка из ISR засчитывается как перелив,
+// даже если уровень уже упал (иначе автомат снова включил бы помпу).
+bool overflowSeen(OverflowCutoff &c) {
+  bool level = digitalRead(c.sensorPin) == HIGH;
+  if (!c.tripped) {
+    if (level && c.armed) cutoffStats.polled++;               // Фронт пришёл до взвода — поймали опросом
+    return level;
+  }
+  c.tripped = false;
+  uint32_t ns = (uint32_t)((uint64_t)(c.cutCycles - c.edgeCycles) * 1000ULL / halCpuMhz());
+  cutoffStats.events++;
+  cutoffStats.hist[histBucket(ns, 250, CUTOFF_HIST_BUCKETS)]++;
+  if (ns < cutoffStats.minNs) cutoffStats.minNs = ns;
+  if (ns > cutoffStats.maxNs) cutoffStats.maxNs = ns;
+  unsigned long ackUs = micros() - c.edgeUs;
+  if (ackUs > cutoffStats.ackMaxUs) cutoffStats.ackMaxUs = ackUs;
+  return true;
+}
+
+// Реле активны LOW: LOW=включено, HIGH=выключено. Группа реле переключается
+// одной записью в регистр «сбросить/установить биты» — одновременно.
+inline void relaysOn(PinMask m)  { halOutLow(m); }
+inline void relaysOff(PinMask m) { halOutHigh(m); }
+
+// Отсечка взводится после включения и снимается до выключения реле:
+// ISR никогда не спорит с автоматом за пин. Срабатывание, не отработанное
+// автоматом до выключения (авария, цель набрана), к следующему пуску не
+// доживает: иначе новый цикл начался бы с ложной аварии или отметки «полон».
+inline void pumpMixOn(Unit& u)   { relaysOn(u.io->pumpMixMask);    u.mixPumpOn = true;   u.mixCut.tripped = false;   u.mixCut.armed = true;    flowSegmentStart(u.mixFlow, millis()); }   // Включить помпу №1
+inline void pumpMixOff(Unit& u)  { u.mixCut.armed = false;   u.mixCut.tripped = false;   relaysOff(u.io->pumpMixMask);   u.mixPumpOn = false;  flowSegmentEnd(u.mixFlow);   }             // Выключить помпу №1
+inline void pumpDroneOn(Unit& u) { relaysOn(u.io->pumpDroneMask);  u.dronePumpOn = true; u.droneCut.tripped = false; u.droneCut.armed = true;  flowSegmentStart(u.droneFlow, millis()); } // Включить помпу №2
+inline void pumpDroneOff(Unit& u){ u.droneCut.armed = false; u.droneCut.tripped = false; relaysOff(u.io->pumpDroneMask); u.dronePumpOn = false; flowSegmentEnd(u.droneFlow); }             // Выключить помпу №2
+inline void valvesOpen(const Unit& u)  { relaysOn(u.io->valvesMask); }   // Открыть оба клапана (A и B — одновременно)
+inline void valvesClose(const Unit& u) { relaysOff(u.io->valvesMask); }  // Закрыть оба клапана
+
+// Конец фазы: длительность и причина (датчик или модель объёма) — в профиль
+void profilePhaseEnd(Unit &u, unsigned long now) {
+  bool bySensor = u.endBySensor;
+  u.endBySensor = false;
+  int ph;
+  switch (u.state) {
+    case ST_FILL_MIX:   ph = PH_MIX;   break;
+    case ST_PUMP_DRONE: ph = PH_DRONE; break;
+    case ST_WAIT_RESET:
+    case ST_FAULT:      ph = PH_WAIT;  break;
+    default:            return;
+  }
+  PhaseStats &st = u.prof.phase[ph];
+  unsigned long ms = now - u.stateSince;
+  if (ph == PH_MIX) u.cycMixMs += ms;
+  else if (ph == PH_DRONE) u.cycDroneMs += ms;
+  st.count++;
+  st.lastMs = ms;
+  if (st.count == 1 || ms < st.minMs) st.minMs = ms;
+  if (ms > st.maxMs) st.maxMs = ms;
+  st.sumMs += ms;
+  if (bySensor) st.bySensor++;
+  else st.byTimer++;
+}
+
+void checkpointUnit(const Unit &u);
+
+// Переход автомата в новое состояние с отметкой времени
+inline void enterState(Unit &u, UnitState s, unsigned long now) {
+  profilePhaseEnd(u, now);
+  u.state = s;
+  u.stateSince = now;
+  if (s == ST_FAULT) u.jobsHeld = true;                              // Дрон мог остаться у станции переполненным
+  checkpointUnit(u);
+}
+
+// ----------- Журнал заправок: кольцо в ОЗУ -----------
+// Одна запись — одно событие цикла. Пишет только задача управления (и setup),
+// забирает во flash только задача интерфейса; кольцо полно — запись
+// отбрасывается и считается, автомат не ждёт.
+
+enum LogEvent : uint8_t {
+  EV_BOOT,                  // Запуск прошивки (станция не указана)
+  EV_MIX,                   // Начата фаза A
+  EV_DRONE,                 // Начата фаза B
+  EV_MIX_FULL,              // Датчик перелива микс-бака
+  EV_OVERFLOW,              // Перелив бака дрона — авария
+  EV_DONE,                  // Цикл завершён
+  EV_RESUME,                // Цикл продолжен после сброса
+  EV_ABORT,                 // Цикл остановлен после сброса
+  EV_COUNT
+};
+
+const char *const LOG_EVENT_NAMES[EV_COUNT] = { "boot", "mix", "drone", "mix_full", "overflow", "done", "resume", "abort" };
+
+// Запись журнала; во flash — как есть (24 байта, little-endian)
+struct FillRecord {
+  uint32_t seq;             // Сквозной номер (продолжается после перезапуска)
+  uint32_t timeMs;          // millis() события
+  uint32_t deliveredMl;     // Налито в дрон за цикл к моменту события
+  uint32_t mixMs;           // Завершённые фазы A цикла, мс
+  uint32_t droneMs;         // Завершённые фазы B цикла, мс
+  uint8_t unit;             // Станция (с 0)
+  uint8_t event;            // LogEvent
+  uint8_t targetLiters;
+  uint8_t crc;              // CRC-8 предыдущих байт
+};
+
+static_assert(sizeof(FillRecord) == 24, "FillRecord: формат записи во flash");
+static_assert((LOG_RING & (LOG_RING - 1)) == 0, "LOG_RING — степень двойки");
+static_assert(LOG_HOLD_RECS >= LOG_BATCH, "LOG_RING мало для NUM_UNITS станций: не хватит запаса до окна для flash");
+
+FillRecord logRing[LOG_RING];
+std::atomic<uint32_t> logHead(0);    // Записано (задача управления)
+std::atomic<uint32_t> logTail(0);    // Забрано во flash (задача интерфейса)
+uint32_t logSeq = 0;                 // Номер следующей записи (logStoreOpen продолжает с flash)
+unsigned long logDropped = 0;        // Кольцо было полно
+std::atomic<bool> flashHold(false);  // Журнал ждёт окна для flash: новые циклы не начинать (пишет интерфейс)
+std::atomic<uint32_t> flashHoldSeq(0);  // Номер запроса окна (пишет интерфейс, перед flashHold)
+std::atomic<uint32_t> flashIdleSeq(0);  // Запрос с этим номером подтверждён: помпы стоят (пишет управление)
+
+inline bool recordValid(const FillRecord &r) {
+  return r.crc == crc8((const uint8_t *)&r, sizeof(r) - 1);
+}
+
+void logPut(FillRecord &r) {
+  uint32_t head = logHead.load();
+  if (head - logTail.load() >= LOG_RING) { logDropped++; return; }
+  r.seq = logSeq++;
+  r.crc = crc8((const uint8_t *)&r, sizeof(r) - 1);
+  logRing[head % LOG_RING] = r;
+  logHead.store(head + 1);                                           // Запись целиком — затем видна читателю
+}
+
+void logFill(const Unit &u, LogEvent ev, unsigned long now) {
+  FillRecord r;
+  r.timeMs = now;
+  r.deliveredMl = u.deliveredMl > 0 ? (uint32_t)u.deliveredMl : 0;
+  r.mixMs = u.cycMixMs;
+  r.droneMs = u.cycDroneMs;
+  r.unit = (uint8_t)(u.io - STATIONS);
+  r.event = ev;
+  r.targetLiters = (uint8_t)u.targetLiters;
+  logPut(r);
+}
+
+// ----------- Контрольная точка (RTC) -----------
+// Пишет только задача управления (и setup). Две копии по очереди: сброс
+// посреди записи портит лишь одну, при запуске берётся свежая с верной CRC.
+
+struct UnitCheckpoint {
+  uint8_t state;                  // UnitState
+  uint8_t targetLiters;
+  uint16_t jobId;                 // Задание хоста этого цикла (0 — цикл с кнопки)
+  uint8_t resumes;                // Продолжений этого цикла после сброса
+  uint8_t reserved[3];
+  int32_t deliveredMl;
+  int32_t mixLevelMl;
+  uint32_t cycMixMs;
+  uint32_t cycDroneMs;
+};
+
+struct Checkpoint {
+  uint32_t magic;                 // CHECKPOINT_MAGIC — иначе в RTC мусор после включения
+  uint32_t seq;                   // Номер записи
+  UnitCheckpoint unit[NUM_UNITS];
+  uint8_t crc;                    // CRC-8 предыдущих полей
+};
+
+#define CHECKPOINT_MAGIC (0x434B0000UL ^ sizeof(Checkpoint))   // Другая раскладка (NUM_UNITS) — не наша точка
+
+RTC_NOINIT_ATTR Checkpoint rtcCheckpoint[2];
+Checkpoint ckWork;                   // Рабочая копия
+
+inline uint8_t checkpointCrc(const Checkpoint &c) {
+  return crc8((const uint8_t *)&c, offsetof(Checkpoint, crc));
+}
+
+void checkpointUnit(const Unit &u) {
+  UnitCheckpoint &k = ckWork.unit[u.io - STATIONS];
+  k.state = u.state;
+  k.targetLiters = (uint8_t)u.targetLiters;
+  k.jobId = u.jobId;
+  k.resumes = u.resumes;
+  k.deliveredMl = u.deliveredMl;
+  k.mixLevelMl = u.mixLevelMl;
+  k.cycMixMs = u.cycMixMs;
+  k.cycDroneMs = u.cycDroneMs;
+  ckWork.seq++;
+  ckWork.crc = checkpointCrc(ckWork);
+  rtcCheckpoint[ckWork.seq & 1] = ckWork;
+}
+
+// Между переходами — по мере перекачки
+void checkpointProgress(const Unit &u) {
+  const UnitCheckpoint &k = ckWork.unit[u.io - STATIONS];
+  if (labs(u.deliveredMl - k.deliveredMl) >= CHECKPOINT_STEP_ML || labs(u.mixLevelMl - k.mixLevelMl) >= CHECKPOINT_STEP_ML) {
+    checkpointUnit(u);
+  }
+}
+
+const Checkpoint *checkpointLatest() {
+  const Checkpoint *best = NULL;
+  for (int i = 0; i < 2; i++) {
+    const Checkpoint &c = rtcCheckpoint[i];
+    if (c.magic != CHECKPOINT_MAGIC || c.crc != checkpointCrc(c)) continue;
+    if (!best || (int32_t)(c.seq - best->seq) > 0) best = &c;
+  }
+  return best;
+}
+
+// ----------- Модель уровня микс-бака -----------
+
+// Шаг обучения мкл/импульс к замеру (явные выбросы — вне 0.5..2× — отбрасываются).
+// Возвращает отклонение замера от прежней калибровки, ‰ (-1 — замер отброшен).
+long learnUlPerPulse(FlowChannel &f, long refMl, uint32_t pulses, int shift) {
+  if (pulses < FLOW_CAL_MIN_PULSES || refMl <= 0) return -1;
+  long measured = (long)((unsigned long long)refMl * 1000ULL / pulses);
+  long was = (long)f.ulPerPulse;
+  if (measured <= was / 2 || measured >= was * 2) return -1;
+  f.ulPerPulse += (measured - was) >> shift;
+  return labs(measured - was) * 1000L / was;
+}
+
+inline bool meterOk(const FlowChannel &f) { return f.pin >= 0 && !f.failed; }
+
+// Известная отметка уровня микс-бака: полный (датчик перелива) или пустой
+// (помпа №2 перестала качать). Между двумя отметками баланс точен:
+// приток − расход = новый уровень − прошлый уровень. Отсюда:
+//  - помпа №2 не работала (или докачала лишь хвост цикла, ошибка её
+//    учёта на нём ничтожна) — приток известен: абсолютная калибровка
+//    расходомера помпы №1 (только от наблюдённой отметки «пуст» до «полон»:
+//    при включении остаток в баке неизвестен, и он не должен попасть в
+//    калибровку). Вес замера — 1/2^FLOW_CAL_ABS_SHIFT, калибровочные наливы
+//    идут, пока замер не совпадёт с калибровкой;
+//  - иначе по измеренному притоку уточняется расходомер помпы №2 (приток —
+//    по уже откалиброванному расходомеру №1 или нулевой).
+void mixLevelKnown(Unit &u, long levelMl) {
+  FlowChannel &in = u.mixFlow;
+  FlowChannel &out = u.droneFlow;
+  long deltaMl = levelMl - u.calLevel0Ml;
+  if (u.calLevel0Ml == LEVEL_UNKNOWN) {
+    // Прошлой отметки нет (старт) или она потеряна — только запоминаем новую
+  } else if (out.totalMl - u.calOut0Ml <= FLOW_CAL_TAIL_ML) {
+    if (meterOk(in) && u.calLevel0Ml == 0) {
+      long refMl = deltaMl + (out.totalMl - u.calOut0Ml);                // Хвост цикла после отметки — в приток
+      long offPm = learnUlPerPulse(in, refMl, in.pulses - u.calInPulses0, FLOW_CAL_ABS_SHIFT);
+      if (offPm >= 0 && offPm <= FLOW_CAL_AGREE_PM) in.calibrated = true;
+    }
+  } else if (meterOk(out) && ((meterOk(in) && in.calibrated) || in.totalMl == u.calIn0Ml)) {
+    learnUlPerPulse(out, in.totalMl - u.calIn0Ml - deltaMl, out.pulses - u.calOutPulses0, FLOW_CAL_SHIFT);
   }
-  lastState = currentState;                             // Обновить «предыдущее» состояние
+  u.mixLevelMl = levelMl;                                            // Модель — по факту
+  u.calLevel0Ml = levelMl;                                           // Новая известная отметка
+  u.calInPulses0 = in.pulses;
+  u.calOutPulses0 = out.pulses;
+  u.calIn0Ml = in.totalMl;
+  u.calOut0Ml = out.totalMl;
 }
 
-// Реле активны LOW: LOW=включено, HIGH=выключено
-inline void pumpMixOn(const Unit& u)   { digitalWrite(u.pumpMixPin, LOW);  } // Включить помпу №1
-inline void pumpMixOff(const Unit& u)  { digitalWrite(u.pumpMixPin, HIGH); } // Выключить помпу №1
-inline void pumpDroneOn(const Unit& u) { digitalWrite(u.relayPin, LOW);    } // Включить помпу №2
-inline void pumpDroneOff(const Unit& u){ digitalWrite(u.relayPin, HIGH);   } // Выключить помпу №2
-inline void valvesOpen(const Unit& u)  { digitalWrite(u.valveAPin, LOW); digitalWrite(u.valveBPin, LOW); } // Открыть оба клапана
-inline void valvesClose(const Unit& u) { digitalWrite(u.valveAPin, HIGH); digitalWrite(u.valveBPin, HIGH);} // Закрыть оба клапана
+inline void mixLevelMark(Unit &u) { mixLevelKnown(u, (long)MIX_TANK_CAPACITY * 1000L); }
+inline void mixEmptyMark(Unit &u) { mixLevelKnown(u, 0); }
+
+// Подготовка канала учёта при запуске (ISR — только при наличии расходомера)
+void setupFlowChannel(FlowChannel &f, int pin, unsigned long now) {
+  f.pin = pin;
+  f.pulses = 0;
+  f.seenPulses = 0;
+  f.fracUl = 0;
+  f.ulPerPulse = FLOW_UL_PER_PULSE;
+  f.msPerLiter = MS_PER_LITER;
+  f.runMs = 0;
+  f.lastPulseMs = now;
+  f.pulseRunMs = 0;
+  f.segRunMs = 0;
+  f.segMl = 0;
+  f.totalMl = 0;
+  f.calibrated = false;
+  f.stalled = false;
+  f.failed = false;
+  if (pin < 0) return;
+  pinMode(pin, INPUT_PULLUP);                                        // Датчик Холла — открытый коллектор
+  attachInterruptArg(digitalPinToInterrupt(pin), flowPulseIsr, &f, FALLING);
+}
+
+// Приток и расход — по каналам учёта (расходомер или время), в миллилитрах.
+// Импульсы помпы №2 пропали при почти пустом по модели баке — это отметка
+// «бак пуст», если они шли с пуска помпы и долива нет (уровень модели до
+// отметки бывает неточен на литры, и при обрыве он тоже «почти пуст»);
+// иначе, как и для помпы №1, — обрыв расходомера.
+void integrateFlows(Unit &u, unsigned long now) {
+  unsigned long dt = now - u.lastModelMs;
+  u.lastModelMs = now;
+  u.mixLevelMl += flowStepMl(u.mixFlow, u.mixPumpOn, dt, now);       // Помпа №1: приток в микс-бак
+  long outMl = flowStepMl(u.droneFlow, u.dronePumpOn, dt, now);      // Помпа №2: расход из микс-бака в дрон
+  u.mixLevelMl -= outMl;
+  u.deliveredMl += outMl;
+
+  if (u.mixFlow.stalled) {
+    u.mixFlow.stalled = false;
+    u.mixLevelMl += flowFail(u.mixFlow);
+  }
+  if (u.droneFlow.stalled) {
+    u.droneFlow.stalled = false;
+    bool pulsed = u.droneFlow.pulseRunMs != u.droneFlow.segRunMs;   // Был импульс с пуска помпы №2
+    if (pulsed && !u.mixPumpOn && u.mixLevelMl <= FLOW_EMPTY_MARK_L * 1000L) {
+      mixEmptyMark(u);
+      u.droneFlow.lastPulseMs = now;
+    } else {
+      long lostMl = flowFail(u.droneFlow);
+      u.mixLevelMl -= lostMl;
+      u.deliveredMl += lostMl;
+    }
+  }
+}
+
+// Сколько ещё нужно подать в микс-бак, чтобы хватило до цели
+inline long mixNeedMl(const Unit &u) {
+  return (long)u.targetLiters * 1000L - u.deliveredMl - u.mixLevelMl;
+}
+
+void startPumpingDrone(Unit &u, unsigned long now);
+void jobEnd(Unit &u, JobResult result, unsigned long now);
+
+// Калибровочный налив нужен, пока абсолютная калибровка расходомера №1 не
+// сошлась, а бак по отметке пуст (с отметки в дрон ушёл лишь хвост цикла).
+inline bool calibrationFillDue(const Unit &u) {
+  return meterOk(u.mixFlow) && !u.mixFlow.calibrated && u.calLevel0Ml == 0
+      && u.droneFlow.totalMl - u.calOut0Ml <= FLOW_CAL_TAIL_ML;
+}
 
 // ----------- Процесс: фаза заполнения микс-бака -----------
-void startFillingMix(Unit &u) {
-  u.fillingMix = true;                                               // Фазу A
-  u.pumpRunning = false;                                             // Помпа №2 не должна работать
-  u.batchLiters = min(MIX_TANK_CAPACITY, u.targetLiters - u.deliveredLiters); // Порция: не больше 20л и не больше остатка
-  if (u.batchLiters <= 0) {                                          // Нечего качать — цикл завершён
-    u.waitBeforeReset = true;                                        // Ставим паузу перед «готово»
-    u.waitStartTime = millis();                                      // Начало паузы
+// В последовательном режиме наполняем порцию целиком (<= MIX_TANK_CAPACITY),
+// в конвейерном — только «затравку» PIPELINE_PRIME_LITERS, а дальше помпа №1
+// доливает бак параллельно с перекачкой в дрон.
+void startFillingMix(Unit &u, unsigned long now) {
+  long needMl = mixNeedMl(u);
+#if PIPELINED_REFILL
+  long portionMl = min(needMl, (long)PIPELINE_PRIME_LITERS * 1000L);  // Затравка перед стартом помпы №2
+#else
+  long portionMl = min(needMl, (long)MIX_TANK_CAPACITY * 1000L);      // Порция: не больше 20л и не больше остатка
+#endif
+  long capMl = (long)MIX_TANK_CAPACITY * 1000L;
+  if (calibrationFillDue(u) && needMl >= capMl) {                    // Расходомер №1 не откалиброван —
+    portionMl = needMl;                                              // наливаем до датчика перелива,
+    capMl = capMl * FLOW_CAL_OVERFILL_PCT / 100;                     // но по модели — лишь чуть выше объёма бака
+  }
+  u.fillGoalMl = min(u.mixLevelMl + portionMl, capMl);
+  u.batchLiters = (int)((u.fillGoalMl - u.mixLevelMl) / 1000L);
+  if (portionMl <= 0) {                                              // Подавать больше нечего
+    if (u.mixLevelMl > 0) {                                          // В баке ещё есть остаток для дрона
+      startPumpingDrone(u, now);
+      return;
+    }
+    enterState(u, ST_WAIT_RESET, now);                               // Нечего качать — цикл завершён
+    logFill(u, EV_DONE, now);
+    jobEnd(u, JOB_DONE, now);
     updateStatusLine(u, 2, "ready again");                           // Выводимстатус
-    return;                                                 
+    return;
+  }
+  if (!u.mixPumpOn) {
+    valvesOpen(u);                                                   // Открываем клапаны A и B
+    pumpMixOn(u);                                                    // Включаем помпу №1
   }
-  valvesOpen(u);                                                     // Открываем клапаны A и B
-  pumpMixOn(u);                                                      // Включаем помпу №1
-  u.pumpStopTime = millis() + (unsigned long)(u.batchLiters * MS_PER_LITER); // Срок окончания фазы A по времени
+  enterState(u, ST_FILL_MIX, now);                                   // Фаза A
+  logFill(u, EV_MIX, now);
 
-  updateStatusLine(u, 2, "mix <- " + String(u.batchLiters));         // На 2-й строке показываем стартовый объём
+  updateStatusLine(u, 2, TextBuf().add("mix <- ").add(u.batchLiters).s);         // На 2-й строке показываем стартовый объём
 
   // RGB: в фазе mix лишь показывает текущмй прогресс (цвет не переливается)
   if (u.targetLiters > 0) {
-    float p = (float)u.deliveredLiters / (float)u.targetLiters;      // Прогресс по уже доставленным литрам
+    float p = (float)u.deliveredMl / (u.targetLiters * 1000.0f);     // Прогресс по уже доставленным литрам
     ledUpdateGradient(u, p);                                         // Установить цвет
   }
 }
@@ -199,20 +1156,20 @@ void startFillingMix(Unit &u) {
 void stopFillingMix(Unit &u) {
   pumpMixOff(u);                                                     // Выключаем помпу №1
   valvesClose(u);                                                    // Закрываем клапаны
-  u.fillingMix = false;                                       
 }
 
 // ----------- Процесс: фаза перекачки в дрон -----------
-void startPumpingDrone(Unit &u) {
-  u.pumpRunning = true;                                              // Фаза B активна
+void startPumpingDrone(Unit &u, unsigned long now) {
   pumpDroneOn(u);                                                    // Включаем помпу №2
-  u.pumpStopTime = millis() + (unsigned long)(u.batchLiters * MS_PER_LITER); // Срок окончания фазы B по времени
+  enterState(u, ST_PUMP_DRONE, now);                                 // Фаза B активна
+  logFill(u, EV_DRONE, now);
+  u.batchLiters = (int)(u.mixLevelMl / 1000L);
 
-  updateStatusLine(u, 2, "pump on <- " + String(u.batchLiters));     // На 2-й строке показываем стартовый объём
+  updateStatusLine(u, 2, TextBuf().add("pump on <- ").add(u.batchLiters).s);     // На 2-й строке показываем стартовый объём
 
   // RGB: установить цвет исходя из уже доставленного объёма
   if (u.targetLiters > 0) {
-    float p = (float)u.deliveredLiters / (float)u.targetLiters;
+    float p = (float)u.deliveredMl / (u.targetLiters * 1000.0f);
     ledUpdateGradient(u, p);
   }
 }
@@ -220,181 +1177,1553 @@ void startPumpingDrone(Unit &u) {
 // Остановка фазы перекачки в дрон
 void stopPumpingDrone(Unit &u) {
   pumpDroneOff(u);                                                   // Выключаем помпу №2
-  u.pumpRunning = false;                               
+}
+
+// Конвейерный долив: помпа №1 работает, пока бак не полон и цель не набрана.
+// Останов — по модели уровня или по датчику перелива микс-бака; повторный
+// пуск — после снижения уровня на PIPELINE_REFILL_HYST_L (без дребезга реле).
+void pipelineRefill(Unit &u, bool mixOverflow) {
+  long capMl = (long)MIX_TANK_CAPACITY * 1000L;
+  long needMl = mixNeedMl(u);
+  if (u.mixPumpOn) {
+    if (mixOverflow || needMl <= 0 || u.mixLevelMl >= capMl) stopFillingMix(u);
+  } else if (!mixOverflow && needMl > 0 && u.mixLevelMl <= capMl - PIPELINE_REFILL_HYST_L * 1000L) {
+    valvesOpen(u);
+    pumpMixOn(u);
+  }
+}
+
+// Каждый цикл заново доверяем расходомеру. Импульсы, пришедшие после обрыва,
+// в объём не идут, а баланс для калибровки с прошлой отметки уже неточен.
+void flowCycleReset(Unit &u, FlowChannel &f) {
+  f.runMs = 0;
+  if (!f.failed) return;
+  f.failed = false;
+  f.seenPulses = f.pulses;
+  f.fracUl = 0;
+  u.calLevel0Ml = LEVEL_UNKNOWN;
+}
+
+// Запуск нового цикла заправки (по START)
+void startCycle(Unit &u, unsigned long now) {
+  u.deliveredMl = 0;                                                 // Новый цикл: счётчики объёма с нуля
+  flowCycleReset(u, u.mixFlow);
+  flowCycleReset(u, u.droneFlow);
+  u.cycleStart = now;
+  u.cycMixMs = u.cycDroneMs = 0;
+  u.resumes = 0;
+  updateStatusLine(u, 3, "");
+  startFillingMix(u, now);
+}
+
+// Итог цикла (в т.ч. аварийного) — в счётчики производительности станции
+void profileCycleEnd(Unit &u, unsigned long now, bool fault) {
+  if (fault) u.prof.faults++;
+  else u.prof.cycles++;
+  u.prof.deliveredMl += u.deliveredMl;
+  u.prof.activeMs += now - u.cycleStart;
+}
+
+// Итог цикла: средняя производительность от START до готовности, л/мин ×10
+void finishCycle(Unit &u, unsigned long now) {
+  unsigned long elapsedMs = now - u.cycleStart;
+  profileCycleEnd(u, now, false);
+  logFill(u, EV_DONE, now);
+  jobEnd(u, JOB_DONE, now);
+  u.lastRateLpm10 = elapsedMs ? (int)((unsigned long long)u.deliveredMl * 600ULL / elapsedMs) : 0;
+  bool flowFail = u.mixFlow.failed || u.droneFlow.failed;            // Был обрыв расходомера — учёт шёл по времени
+  updateStatusLine(u, 3, TextBuf().add("rate ").add(u.lastRateLpm10 / 10).add(".").add(u.lastRateLpm10 % 10)
+                             .add(" L/min").add(flowFail ? " F!" : "").s);
+}
+
+// ----------- Шаг автомата станции -----------
+// Сначала датчики и реле, затем индикация: время от датчика до реле
+// определяется длительностью одного прохода, а не работой дисплея.
+void tickUnit(Unit &u, unsigned long now) {
+  integrateFlows(u, now);                                            // Обновить модель уровня/объёмов
+
+  switch (u.state) {
+    case ST_IDLE:                                                    // Ждём START (обрабатывается в loop)
+      break;
+
+    case ST_FILL_MIX: {                                              // --- Фаза A: наполнение микс-бака ---
+      bool mixOverflow = overflowSeen(u.mixCut);                     // Контроль перелива микс-бака
+      if (mixOverflow) {                                             // Если сработал датчик — бак полный
+        mixLevelMark(u);
+        u.prof.mixTrips++;
+        u.endBySensor = true;
+        logFill(u, EV_MIX_FULL, now);
+      }
+      if (mixOverflow || u.mixLevelMl >= u.fillGoalMl) {             // Условия завершения фазы A
+#if PIPELINED_REFILL
+        if (mixOverflow) stopFillingMix(u);                          // Помпа №1 продолжает доливать, если есть куда
+#else
+        stopFillingMix(u);                                           // Остановить помпу №1 и закрыть клапаны
+#endif
+        startPumpingDrone(u, now);                                   // Перейти к фазе B
+        break;
+      }
+      int remainingL = (int)((u.fillGoalMl - u.mixLevelMl) / 1000L); // Оставшиеся литры порции
+      if (remainingL != u.currentLiters) {                           // Обновлять строку только при изменении
+        u.currentLiters = remainingL;
+        updateStatusLine(u, 2, TextBuf().add("mix <- ").add(u.currentLiters).s); // Отсчёт для фазы A
+      }
+      break;
+    }
+
+    case ST_PUMP_DRONE: {                                            // --- Фаза B: перекачка в дрон ---
+      bool droneOverflow = overflowSeen(u.droneCut);                 // Контроль перелива бака дрона
+      if (droneOverflow) {                                           // Авария по датчику дрона
+        stopPumpingDrone(u);                                         // Остановить помпу №2
+        if (u.mixPumpOn) stopFillingMix(u);                          // и долив (конвейерный режим)
+        ledRed(u);                                                   // Мгновенно красный
+        u.prof.droneTrips++;
+        u.endBySensor = true;
+        profileCycleEnd(u, now, true);
+        enterState(u, ST_FAULT, now);                                // Цикл останавливается
+        logFill(u, EV_OVERFLOW, now);
+        jobEnd(u, JOB_OVERFLOW, now);
+        updateStatusLine(u, 2, "filled in ");                        // Сообщение о переливе
+        break;
+      }
+#if PIPELINED_REFILL
+      bool mixOverflow = overflowSeen(u.mixCut);                     // Датчик микс-бака — и при доливе
+      if (mixOverflow && u.mixPumpOn) {                              // Отметка — пока идёт долив
+        mixLevelMark(u);
+        u.prof.mixTrips++;
+        logFill(u, EV_MIX_FULL, now);
+      }
+      pipelineRefill(u, mixOverflow);
+#endif
+      if (u.deliveredMl >= (long)u.targetLiters * 1000L) {           // Цель набрана — завершение
+        stopPumpingDrone(u);                                         // Остановить помпу №2
+        if (u.mixPumpOn) stopFillingMix(u);
+        enterState(u, ST_WAIT_RESET, now);
+        updateStatusLine(u, 2, "pump off ");                         // Сообщение «помпа выкл»
+        finishCycle(u, now);
+        ledOff(u);                                                   // Готово — выключаем диод
+        break;
+      }
+      if (u.mixLevelMl <= 0) {                                       // Микс-бак опустел
+        stopPumpingDrone(u);                                         // Остановить помпу №2
+        u.mixLevelMl = 0;
+        startFillingMix(u, now);                                     // Вернуться к фазе A (долив мог уже идти)
+        break;
+      }
+
+#if PIPELINED_REFILL
+      int remainingL = (int)(((long)u.targetLiters * 1000L - u.deliveredMl) / 1000L); // Остаток до цели
+#else
+      int remainingL = (int)(u.mixLevelMl / 1000L);                  // Остаток порции в баке
+#endif
+      if (remainingL != u.currentLiters) {                           // Обновление строки статуса
+        u.currentLiters = remainingL;
+        updateStatusLine(u, 2, TextBuf().add("pump on <- ").add(u.currentLiters).s); // Отсчёт для фазы B
+#if PIPELINED_REFILL
+        updateStatusLine(u, 3, TextBuf().add("tank ").add(u.mixLevelMl / 1000L).add(" L").s);  // Уровень микс-бака по модели
+#endif
+      }
+
+      // RGB-индикация
+      if (u.targetLiters > 0) {
+        float progress01 = (float)u.deliveredMl / (u.targetLiters * 1000.0f); // 0..1
+        ledUpdateGradient(u, progress01);                            // Обновить цвет по прогрессу
+      }
+      break;
+    }
+
+    case ST_WAIT_RESET:                                              // --- Пауза перед разрешением нового запуска ---
+    case ST_FAULT:                                                   // (после аварии — та же пауза, диод красный)
+      if (now - u.stateSince >= RESET_WAIT_MS) {
+        enterState(u, ST_IDLE, now);                                 // Разрешить новый цикл
+        updateStatusLine(u, 2, "ready again");                       // Сообщение о повторной подготовке к работе
+        ledOff(u);                                                   // Выключаем диод (в т.ч. после аварии)
+      }
+      break;
+  }
+
+  checkpointProgress(u);                                             // Объёмы — в RTC по мере перекачки
 }
 
 // ----------- Инициализацияпинов станции -----------
 void setupUnitIO(Unit &u, int idx) {
-  pinMode(u.moisturePin, INPUT);                                     // Датчик перелива дрона
-  pinMode(u.relayPin, OUTPUT);                                       // Реле помпы №2
-  pinMode(u.mixMoisturePin, INPUT);                                  // Датчик перелива микс-бака
-  pinMode(u.pumpMixPin, OUTPUT);                                     // Реле помпы №1
-  pinMode(u.valveAPin, OUTPUT);                                      // Реле клапана A
-  pinMode(u.valveBPin, OUTPUT);                                      // Реле клапана B
+  const Station &io = STATIONS[idx];
+  u.io = &io;
+  relaysOff(io.pumpMixMask | io.pumpDroneMask | io.valvesMask);      // Уровень HIGH — до включения выходов: реле не щёлкнут
+  pinMode(io.moisturePin, INPUT);                                    // Датчик перелива дрона
+  pinMode(io.relayPin, OUTPUT);                                      // Реле помпы №2
+  pinMode(io.mixMoisturePin, INPUT);                                 // Датчик перелива микс-бака
+  pinMode(io.pumpMixPin, OUTPUT);                                    // Реле помпы №1
+  pinMode(io.valveAPin, OUTPUT);                                     // Реле клапана A
+  pinMode(io.valveBPin, OUTPUT);                                     // Реле клапана B
+
+  setupOverflowCutoff(u.mixCut, io.mixMoisturePin, io.pumpMixMask);  // Отсечка по переливу — до первого пуска помп
+  setupOverflowCutoff(u.droneCut, io.moisturePin, io.pumpDroneMask);
 
   pumpDroneOff(u);                                                   // Все исполнительные — в OFF
   pumpMixOff(u);
   valvesClose(u);
 
-  u.pumpRunning = false;                                             // Стартовые флаги/значения
-  u.readyToStart = true;
-  u.waitBeforeReset = false;
-  u.needsDisplayUpdate = true;
-  u.lastDisplayedLiters = -1;
-  u.pumpStopTime = 0;
+  u.state = ST_IDLE;                                                 // Стартовые флаги/значения
+  u.stateSince = 0;
   u.targetLiters = 0;
   u.currentLiters = 0;
 
-  u.fillingMix = false;
-  u.deliveredLiters = 0;
   u.batchLiters = 0;
+  u.mixLevelMl = 0;                                                  // Считаем микс-бак пустым
+  u.deliveredMl = 0;
+  u.fillGoalMl = 0;
+  u.lastModelMs = millis();
+  setupFlowChannel(u.mixFlow, io.flowMixPin, u.lastModelMs);         // Расходомеры (если подключены)
+  setupFlowChannel(u.droneFlow, io.flowDronePin, u.lastModelMs);
+  u.calLevel0Ml = LEVEL_UNKNOWN;                                     // Остаток в баке при включении неизвестен
+  u.calInPulses0 = 0;
+  u.calOutPulses0 = 0;
+  u.calIn0Ml = 0;
+  u.calOut0Ml = 0;
+  u.cycleStart = 0;
+  u.cycMixMs = u.cycDroneMs = 0;
+  u.lastRateLpm10 = 0;
+  u.endBySensor = false;
+  u.resumes = 0;
+  u.jobId = 0;
+  u.jobsHeld = false;
+  memset(&u.prof, 0, sizeof(u.prof));
 
-  u.statusLine2 = "";                                                // Сброс кэша строк
-  u.statusLine3 = "";
-
-  // Выделяем 3 PWM-канала под станцию (R/G/B)
-  u.ledChR = idx*3 + 0;
-  u.ledChG = idx*3 + 1;
-  u.ledChB = idx*3 + 2;
+  u.statusLine2[0] = 0;                                              // Сброс кэша строк
+  u.statusLine3[0] = 0;
 
-  ledcSetup(u.ledChR, 5000, 8);                                      // Частота 5 кГц, 8 бит (0..255)
-  ledcSetup(u.ledChG, 5000, 8);
-  ledcSetup(u.ledChB, 5000, 8);
+  // 3 PWM-канала станции (R/G/B) — из разводки, пересечения отсекает static_assert
+  ledcSetup(io.ledChannel + 0, 5000, 8);                             // Частота 5 кГц, 8 бит (0..255)
+  ledcSetup(io.ledChannel + 1, 5000, 8);
+  ledcSetup(io.ledChannel + 2, 5000, 8);
 
-  ledcAttachPin(u.ledRPin, u.ledChR);                                // Привязываем пины к каналам
-  ledcAttachPin(u.ledGPin, u.ledChG);
-  ledcAttachPin(u.ledBPin, u.ledChB);
+  ledcAttachPin(io.ledRPin, io.ledChannel + 0);                      // Привязываем пины к каналам
+  ledcAttachPin(io.ledGPin, io.ledChannel + 1);
+  ledcAttachPin(io.ledBPin, io.ledChannel + 2);
 
   ledOff(u);                                                         // На старте — свет выключен
+  ledWriteRGB(u, 0, 0, 0);                                           // (задачи ещё не запущены — пишем сразу)
   u.lastProgress01 = 0.0f;                                           // Прогресс памяти = 0
 }
 
-// ----------- глобальная инициализация -----------
-void setup() {
-  Serial.begin(115200);                                              // UART для отладки
-  Wire.begin(21, 22);                                                // I2C с явными SDA=21, SCL=22 (ESP32)
-  lcd.init();                                                        // Инициализация LCD
-  lcd.backlight();                                                   // Подсветка LCD
-  lcd.setCursor(0, 0);
-  lcd.print("system on");                                            // Сообщение о работе системы
-  delay(500);                                                   
+// ----------- Запуск: восстановление после сброса -----------
 
-  pinMode(POT_PIN, INPUT);                                           // Потенциометр — вход (ADC)
-  pinMode(START_BTN_PIN, INPUT_PULLUP);                              // Кнопка старта
-  pinMode(SWITCH_BTN_PIN, INPUT_PULLUP);                             // Кнопка переключения
+// Время запуска (micros() от сброса) и итог восстановления
+struct BootInfo {
+  unsigned long setupUs;          // Вход в setup()
+  unsigned long safeUs;           // Реле в OFF, станции восстановлены
+  unsigned long readyUs;          // Первый шаг управления: START и задатчики принимаются
+  unsigned long lcdUs;            // LCD готов (инициализация HD44780 — десятки мс)
+  bool checkpoint;                // В RTC была верная контрольная точка
+  uint8_t resumed;                // Станций, продолживших цикл
+  uint8_t aborted;                // Станций, остановленных аварией
+};
 
-  for (int i = 0; i < NUM_UNITS; i++) {                              // Инициализация всех станций
-    setupUnitIO(units[i], i);                                        // Индекс для назначения PWM-каналов
+BootInfo bootInfo;
+
+// Станции — по контрольной точке: уровень микс-бака всегда, прерванный цикл —
+// продолжить (остаток считается от сохранённого объёма) или, если дрон уже
+// полон по датчику либо цикл прерывался уже RESUME_MAX раз, остановить аварией
+void checkpointRestore(unsigned long now) {
+  const Checkpoint *ck = checkpointLatest();
+  bootInfo.checkpoint = ck != NULL;
+  if (ck) ckWork = *ck;
+  else {
+    memset(&ckWork, 0, sizeof(ckWork));
+    ckWork.magic = CHECKPOINT_MAGIC;
+  }
+  for (int i = 0; i < NUM_UNITS; i++) {
+    Unit &u = units[i];
+    const UnitCheckpoint k = ckWork.unit[i];
+    if (ck) u.mixLevelMl = k.mixLevelMl;                            // Уровень из модели — не отметка датчика
+    if (!ck || (k.state != ST_FILL_MIX && k.state != ST_PUMP_DRONE)) {
+      checkpointUnit(u);                                             // Ожидание или пауза — просто начать заново
+      continue;
+    }
+    u.targetLiters = k.targetLiters;
+    u.currentLiters = k.targetLiters;
+    u.jobId = k.jobId;                                               // Итог — хосту (jobRestore)
+    u.deliveredMl = k.deliveredMl;
+    u.cycMixMs = k.cycMixMs;
+    u.cycDroneMs = k.cycDroneMs;
+    u.cycleStart = now;
+    bool droneFull = halPinLevel(u.io->moisturePin);
+    if (RESUME_AFTER_RESET && k.resumes < RESUME_MAX && !droneFull) {
+      u.resumes = k.resumes + 1;
+      logFill(u, EV_RESUME, now);
+      updateStatusLine(u, 3, "resumed");
+      startFillingMix(u, now);                                       // Фаза A или сразу B — по остатку
+      bootInfo.resumed++;
+    } else {
+      ledRed(u);
+      enterState(u, ST_FAULT, now);
+      logFill(u, EV_ABORT, now);
+      updateStatusLine(u, 2, "power lost");
+      updateStatusLine(u, 3, TextBuf().add("got ").add(u.deliveredMl / 1000L).add(" L").s);
+      bootInfo.aborted++;
+    }
   }
+}
+
+// ----------- Очередь заданий -----------
+// Очередями станций владеет только задача управления. Кадры хоста принимает
+// задача интерфейса и передаёт сюда через jobRequests; ответы и уведомления
+// уходят обратно готовыми кадрами через jobNotify. Ни одна сторона не ждёт:
+// кольцо полно — запрос отклоняется, уведомление отбрасывается и считается.
+
+// Кольцо «один писатель → один читатель» между задачами
+template <class T, unsigned N>
+struct SpscRing {
+  static_assert((N & (N - 1)) == 0, "SpscRing: N — степень двойки");
+  T items[N];
+  std::atomic<uint32_t> head;     // Записано (писатель)
+  std::atomic<uint32_t> tail;     // Забрано (читатель)
+
+  bool push(const T &v) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= N) return false;
+    items[h % N] = v;
+    head.store(h + 1, std::memory_order_release);                    // Элемент целиком — затем виден читателю
+    return true;
+  }
+
+  bool pop(T &v) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    v = items[t % N];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+};
 
-  lcd.clear();                                                       // Начальный экран
-  lcd.setCursor(0, 0);
-  lcd.print("station 1");
-  lcdPrintClear(0, 1, "liters: 0");                                  // Строка 1: литры=0 (до вращения потенциометра)
+struct Job {
+  uint16_t id;
+  uint8_t liters;
+  uint8_t priority;
+};
+
+struct JobQueue {
+  Job jobs[JOB_QUEUE_LEN];        // В порядке постановки
+  uint8_t count;
+};
+
+// Проверенный задачей интерфейса ENQUEUE, CANCEL или RESUME
+struct JobRequest {
+  uint8_t type;
+  uint8_t unit;
+  uint8_t liters;                 // Только ENQUEUE
+  uint8_t priority;
+  uint16_t jobId;
+};
+
+struct ProtoFrame {
+  uint8_t len;
+  uint8_t bytes[PROTO_MAX_FRAME];
+};
+
+struct JobStats {
+  unsigned long enqueued;         // Принято в очереди
+  unsigned long rejected;         // Очередь станции была полна
+  unsigned long cancelled;
+  unsigned long started;
+  unsigned long done;
+  unsigned long faults;           // Завершены аварией
+  unsigned long notifyDropped;    // Кольцо уведомлений было полно
+};
+
+JobQueue jobQueues[NUM_UNITS];
+SpscRing<JobRequest, JOB_REQUEST_RING> jobRequests;  // Интерфейс → управление
+SpscRing<ProtoFrame, JOB_NOTIFY_RING> jobNotify;     // Управление → интерфейс (Serial)
+JobStats jobStats;
+
+void jobSend(uint8_t type, const void *payload, uint8_t len) {
+  ProtoFrame f;
+  f.len = (uint8_t)protoEncode(f.bytes, type, payload, len);
+  if (!jobNotify.push(f)) jobStats.notifyDropped++;
 }
 
-// ----------- главный цикл -----------
-void loop() {
-  handleUnitSwitch();                                                // Обработка переключения станций
-  Unit &unit = units[currentUnit];                                   // текущая активная станция
-
-  if (unit.needsDisplayUpdate) {                                     // Если требуется принудительное обновление экрана
-    refreshDisplayForUnit(unit);                                   
-  }
-
-  // --- Режим ожидания ---
-  if (!unit.fillingMix && !unit.pumpRunning && unit.readyToStart) {
-    int potValue = analogRead(POT_PIN);                              // Считываем потенциометр (0..4095)
-    unit.targetLiters = map(potValue, 0, 4095, 1, 100);              // Переводим в диапазон 1..100 литров
-    if (unit.targetLiters != unit.lastDisplayedLiters || unit.needsDisplayUpdate) {
-      unit.currentLiters = unit.targetLiters;                        // Для согласованности отображения
-      lcdPrintClear(0, 1, "liters: " + String(unit.targetLiters));   // Показать целевое
-      unit.lastDisplayedLiters = unit.targetLiters;                  
-      unit.needsDisplayUpdate = false;                               
+void jobRemove(JobQueue &q, int k) {
+  q.count--;
+  for (int i = k; i < q.count; i++) q.jobs[i] = q.jobs[i + 1];
+}
+
+// Следующее задание: наибольший приоритет, при равном — раньше поставленное
+int jobNext(const JobQueue &q) {
+  int best = 0;
+  for (int i = 1; i < q.count; i++) {
+    if (q.jobs[i].priority > q.jobs[best].priority) best = i;
+  }
+  return best;
+}
+
+void jobApply(const JobRequest &r) {
+  JobQueue &q = jobQueues[r.unit];
+  uint8_t result = RES_OK;
+  if (r.type == MSG_ENQUEUE) {
+    if (q.count >= JOB_QUEUE_LEN) {
+      result = RES_QUEUE_FULL;
+      jobStats.rejected++;
+    } else {
+      Job &j = q.jobs[q.count++];
+      j.id = r.jobId;
+      j.liters = r.liters;
+      j.priority = r.priority;
+      jobStats.enqueued++;
+    }
+  } else if (r.type == MSG_RESUME) {
+    units[r.unit].jobsHeld = false;                                  // Хост: авария разобрана
+  } else {                                                           // MSG_CANCEL: начатое не отменяется
+    int k = 0;
+    while (k < q.count && q.jobs[k].id != r.jobId) k++;
+    if (k == q.count) result = RES_NOT_FOUND;
+    else {
+      jobRemove(q, k);
+      jobStats.cancelled++;
     }
   }
+  MsgAck a;
+  a.type = r.type;
+  a.jobId = r.jobId;
+  a.result = result;
+  a.queued = q.count;
+  jobSend(MSG_ACK, &a, sizeof(a));
+}
+
+void jobSendStart(const Unit &u) {
+  MsgJobStart m;
+  m.unit = (uint8_t)(u.io - STATIONS);
+  m.jobId = u.jobId;
+  m.liters = (uint8_t)u.targetLiters;
+  jobSend(MSG_JOB_START, &m, sizeof(m));
+}
+
+// Цикл по заданию — как по START, но цель из задания
+void jobStart(Unit &u, int idx, unsigned long now) {
+  JobQueue &q = jobQueues[idx];
+  int k = jobNext(q);
+  Job j = q.jobs[k];
+  jobRemove(q, k);
+  u.targetLiters = j.liters;
+  u.currentLiters = j.liters;
+  u.jobId = j.id;
+  jobStats.started++;
+  jobSendStart(u);
+  startCycle(u, now);
+}
+
+// Итог цикла по заданию — хосту; цикл с кнопки не сообщается
+void jobEnd(Unit &u, JobResult result, unsigned long now) {
+  if (!u.jobId) return;
+  if (result == JOB_DONE) jobStats.done++;
+  else jobStats.faults++;
+  MsgJobEnd m;
+  m.unit = (uint8_t)(u.io - STATIONS);
+  m.jobId = u.jobId;
+  m.result = result;
+  m.deliveredMl = u.deliveredMl > 0 ? (uint32_t)u.deliveredMl : 0;
+  m.durationMs = (uint32_t)(now - u.cycleStart);
+  jobSend(MSG_JOB_END, &m, sizeof(m));
+  u.jobId = 0;
+}
+
+// Задание, шедшее при сбросе (setup, после checkpointRestore): продолженное —
+// JOB_START заново, остановленное — JOB_END с JOB_ABORTED. Кадры ждут HELLO.
+void jobRestore(unsigned long now) {
+  for (int i = 0; i < NUM_UNITS; i++) {
+    Unit &u = units[i];
+    if (!u.jobId) continue;
+    if (u.state == ST_FAULT) jobEnd(u, JOB_ABORTED, now);
+    else jobSendStart(u);
+  }
+}
+
+// Шаг очередей (задача управления): запросы хоста, затем автостарт — станция,
+// только что вышедшая из паузы (ST_WAIT_RESET/ST_FAULT → ST_IDLE в tickUnit
+// этого же шага), сразу берёт следующее задание. Пока журнал ждёт окна для
+// flash, новые задания не начинаются. После аварии очередь станции стоит до
+// RESUME или START, и в любом случае — пока датчик дрона мокрый: иначе
+// следующее задание сразу кончилось бы переливом в тот же дрон.
+void jobService(unsigned long now) {
+  JobRequest r;
+  while (jobRequests.pop(r)) jobApply(r);
+  if (flashHold.load()) return;
+  for (int i = 0; i < NUM_UNITS; i++) {
+    Unit &u = units[i];
+    if (u.state != ST_IDLE || !jobQueues[i].count || u.jobsHeld) continue;
+    if (!halPinLevel(u.io->moisturePin)) jobStart(u, i, now);
+  }
+}
+
+// Подтверждение запроса окна для flash (конец шага управления): номер читается
+// до проверки станций — пуск, случившийся раньше в этом шаге, её не пройдёт,
+// а следующие шаги уже видят flashHold и циклов не начинают.
+void flashAck() {
+  if (!flashHold.load()) return;
+  uint32_t seq = flashHoldSeq.load();
+  for (int i = 0; i < NUM_UNITS; i++) {
+    const Unit &u = units[i];
+    if (u.state == ST_FILL_MIX || u.state == ST_PUMP_DRONE || u.mixPumpOn || u.dronePumpOn) return;
+  }
+  flashIdleSeq.store(seq);
+}
+
+// ---------------- heap ----------------
+
+// Контроль кучи: рабочий цикл не должен выделять память вовсе.
+// Каждый шаг интерфейса сверяет свободный объём (O(1)) — любое изменение после
+// setup() считается событием выделения/освобождения; раз в HEAP_INFO_MS
+// снимается полная картина: минимум свободного, крупнейший блок, фрагментация.
+#define HEAP_INFO_MS 5000
+
+struct HeapStats {
+  uint32_t freeBytes;             // Свободно сейчас
+  uint32_t minFreeBytes;          // Минимум свободного с запуска (водяной знак)
+  uint32_t largestBlock;          // Крупнейший свободный блок
+  uint32_t fragPct;               // Фрагментация: 100 − крупнейший блок / свободно, %
+  uint32_t allocatedBlocks;       // Занятых блоков
+  unsigned long changes;          // Проходов, в которых свободный объём изменился
+  unsigned long lastInfoMs;       // Последний полный снимок
+};
+
+HeapStats heapStats = { 0, 0, 0, 0, 0, 0, 0 };
+
+void heapSnapshot(unsigned long now) {
+  HalHeapInfo info;
+  halHeapInfo(info);
+  heapStats.minFreeBytes = info.minFreeBytes;
+  heapStats.largestBlock = info.largestBlock;
+  heapStats.allocatedBlocks = info.allocatedBlocks;
+  heapStats.fragPct = info.freeBytes ? 100 - (uint32_t)(100ULL * info.largestBlock / info.freeBytes) : 0;
+  heapStats.lastInfoMs = now;
+}
+
+void heapWatch(unsigned long now) {
+  uint32_t freeBytes = halHeapFree();
+  if (freeBytes != heapStats.freeBytes) {
+    heapStats.freeBytes = freeBytes;
+    heapStats.changes++;
+  }
+  if (now - heapStats.lastInfoMs >= HEAP_INFO_MS) heapSnapshot(now);
+}
+
+// Точка отсчёта — конец setup(): дальше событий быть не должно
+void heapBaseline(unsigned long now) {
+  heapStats.freeBytes = halHeapFree();
+  heapStats.changes = 0;
+  heapSnapshot(now);
+}
+
+// ---------------- задачи ----------------
+
+// Разделение по ядрам ESP32. Задача управления (ядро 1, высокий приоритет)
+// владеет автоматами станций, кнопками, потенциометром и реле. Задача
+// интерфейса (ядро 0, низкий приоритет) владеет LCD, каналами LEDC и Serial.
+// Данные идут в одну сторону — снимками состояния станций через seqlock:
+// писатель никогда не ждёт читателя, поэтому медленный I2C не может
+// задержать отключение помпы.
+#define CONTROL_CORE      1
+#define UI_CORE           0
+#define CONTROL_PRIORITY  (configMAX_PRIORITIES - 2)
+#define UI_PRIORITY       1
+#define CONTROL_STACK     4096
+#define UI_STACK          4096
+#define CYCLE_HIST_BUCKETS  12         // Гистограммы периода и работы задачи: <16 мкс, <32 мкс, … ×2, последняя — остальное
+#define CYCLE_HIST_FIRST_US 16
+
+// Снимок станции — всё, что нужно интерфейсу для экрана и диода
+struct UnitSnapshot {
+  UnitState state;
+  uint8_t ledMode;
+  int targetLiters;
+  float progress01;
+  long deliveredMl;
+  uint16_t jobId;
+  uint8_t queued;                 // Заданий в очереди станции
+  bool jobsHeld;
+  char line2[LCD_COLS + 1];
+  char line3[LCD_COLS + 1];
+};
+
+struct SnapshotSlot {
+  std::atomic<uint32_t> seq;      // Чётный — снимок целый, нечётный — идёт запись
+  UnitSnapshot data;
+};
+
+SnapshotSlot snapshots[NUM_UNITS];
+
+// Публикация снимка (только задача управления): seq нечётный → данные → seq чётный
+void publishUnit(int idx) {
+  SnapshotSlot &sl = snapshots[idx];
+  const Unit &u = units[idx];
+  uint32_t seq = sl.seq.load(std::memory_order_relaxed);
+  sl.seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  sl.data.state = u.state;
+  sl.data.ledMode = u.ledMode;
+  sl.data.targetLiters = u.targetLiters;
+  sl.data.progress01 = u.lastProgress01;
+  sl.data.deliveredMl = u.deliveredMl;
+  sl.data.jobId = u.jobId;
+  sl.data.queued = jobQueues[idx].count;
+  sl.data.jobsHeld = u.jobsHeld;
+  memcpy(sl.data.line2, u.statusLine2, sizeof(sl.data.line2));
+  memcpy(sl.data.line3, u.statusLine3, sizeof(sl.data.line3));
+  sl.seq.store(seq + 2, std::memory_order_release);
+}
+
+// Чтение снимка (задача интерфейса): копия повторяется, если писатель вмешался
+void readSnapshot(int idx, UnitSnapshot &out) {
+  SnapshotSlot &sl = snapshots[idx];
+  for (;;) {
+    uint32_t seq = sl.seq.load(std::memory_order_acquire);
+    if (seq & 1) continue;                                  // Запись идёт прямо сейчас (на другом ядре)
+    memcpy(&out, &sl.data, sizeof(out));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sl.seq.load(std::memory_order_relaxed) == seq) return;
+  }
+}
+
+// Замер задачи: период между запусками (джиттер = max − min) и время работы.
+// Счётчики пишет только задача-владелец; отчёт лишь просит сбросить окно.
+struct TaskTiming {
+  unsigned long runs;             // Запусков в окне
+  unsigned long lastStartUs;      // Начало предыдущего запуска
+  unsigned long minPeriodUs;      // Минимальный период в окне, мкс
+  unsigned long maxPeriodUs;      // Максимальный период в окне, мкс
+  unsigned long sumExecUs;        // Сумма времени работы, мкс
+  unsigned long maxExecUs;        // Максимальное время работы, мкс
+  unsigned long sumWorkUs;        // Сумма отдельно замеренной части (управление: шаги автоматов)
+  bool primed;                    // Был хотя бы один запуск (есть от чего считать период)
+  volatile bool resetReq;         // Отчёт просит начать новое окно
+  unsigned long periodHist[CYCLE_HIST_BUCKETS]; // Гистограмма периода (время цикла), мкс
+  unsigned long execHist[CYCLE_HIST_BUCKETS];   // Гистограмма времени работы, мкс
+};
+
+TaskTiming controlTiming = { 0, 0, ULONG_MAX, 0, 0, 0, 0, false, false, {}, {} };
+TaskTiming uiTiming      = { 0, 0, ULONG_MAX, 0, 0, 0, 0, false, false, {}, {} };
+
+void timingRun(TaskTiming &t, unsigned long startUs, unsigned long endUs, unsigned long workUs) {
+  if (t.resetReq) {
+    t.runs = t.sumExecUs = t.maxExecUs = t.maxPeriodUs = t.sumWorkUs = 0;
+    t.minPeriodUs = ULONG_MAX;
+    memset(t.periodHist, 0, sizeof(t.periodHist));
+    memset(t.execHist, 0, sizeof(t.execHist));
+    t.resetReq = false;
+  }
+  if (t.primed) {
+    unsigned long period = startUs - t.lastStartUs;
+    if (period < t.minPeriodUs) t.minPeriodUs = period;
+    if (period > t.maxPeriodUs) t.maxPeriodUs = period;
+    t.periodHist[histBucket(period, CYCLE_HIST_FIRST_US, CYCLE_HIST_BUCKETS)]++;
+  }
+  t.primed = true;
+  t.lastStartUs = startUs;
+  unsigned long exec = endUs - startUs;
+  t.runs++;
+  t.sumExecUs += exec;
+  t.sumWorkUs += workUs;
+  if (exec > t.maxExecUs) t.maxExecUs = exec;
+  t.execHist[histBucket(exec, CYCLE_HIST_FIRST_US, CYCLE_HIST_BUCKETS)]++;
+}
+
+// ---------------- Serial: замеры и команды ----------------
+
+// Вывод идёт через кольцевую очередь: отчёт формируется в память сразу,
+// а в UART уходит не больше, чем там свободно (availableForWrite) — шаг
+// интерфейса никогда не ждёт передачи. Не поместившееся отбрасывается и
+// считается. Команды — строки ASCII до перевода строки, читаются без ожидания;
+// между ними могут идти кадры двоичного протокола (src/proto.h).
+#define SERIAL_OUT_BUF  2048           // Очередь вывода, байт
+#define SERIAL_CMD_MAX  24             // Длина строки команды, символов
+
+char serialOut[SERIAL_OUT_BUF];
+unsigned serialOutHead = 0;          // Позиция записи
+unsigned serialOutTail = 0;          // Позиция передачи в UART
+unsigned long serialOutDropped = 0;  // Байт, не поместившихся в очередь
+
+char cmdLine[SERIAL_CMD_MAX + 1];    // Принимаемая команда
+uint8_t cmdLen = 0;
+bool cmdTooLong = false;             // Строка длиннее буфера — отбросить до перевода строки
+
+volatile bool profileResetReq = false; // Сброс профилей станций и отсечки (выполняет задача управления)
+unsigned long benchWindowStart = 0;
+
+void outText(const char *t) {
+  for (; *t; t++) {
+    unsigned next = (serialOutHead + 1) % SERIAL_OUT_BUF;
+    if (next == serialOutTail) { serialOutDropped += strlen(t); return; }
+    serialOut[serialOutHead] = *t;
+    serialOutHead = next;
+  }
+}
+
+void outNum(unsigned long v) {
+  char digits[11];
+  int i = 10;
+  digits[i] = 0;
+  do { digits[--i] = (char)('0' + v % 10); v /= 10; } while (v);
+  outText(digits + i);
+}
 
-  // --- Старт цикла по кнопке ---
-  if (!unit.fillingMix && !unit.pumpRunning && unit.readyToStart && digitalRead(START_BTN_PIN) == LOW) {
-    delay(50);                                                       
-    if (digitalRead(START_BTN_PIN) == LOW) {                         
-      unit.readyToStart = false;                                     
-      unit.deliveredLiters = 0;                                      
-      unit.needsDisplayUpdate = true;                                
-      startFillingMix(unit);                                         
-      while (digitalRead(START_BTN_PIN) == LOW);                     
+// « key=value»
+void outKV(const char *key, unsigned long v) {
+  outText(" "); outText(key); outText("="); outNum(v);
+}
+
+// « key=N.N» для величин ×10
+void outKV10(const char *key, unsigned long v10) {
+  outKV(key, v10 / 10); outText("."); outNum(v10 % 10);
+}
+
+// « key=a,b,c…»
+void outHist(const char *key, const unsigned long *h, int n) {
+  outText(" "); outText(key); outText("=");
+  for (int i = 0; i < n; i++) {
+    if (i) outText(",");
+    outNum(h[i]);
+  }
+}
+
+// Передать очередь в UART — не больше свободного места, без ожидания
+void serialDrain() {
+  int room = Serial.availableForWrite();
+  while (room > 0 && serialOutTail != serialOutHead) {
+    unsigned end = serialOutHead > serialOutTail ? serialOutHead : SERIAL_OUT_BUF;
+    unsigned n = min((unsigned)room, end - serialOutTail);
+    Serial.write((const uint8_t *)serialOut + serialOutTail, n);
+    serialOutTail = (serialOutTail + n) % SERIAL_OUT_BUF;
+    room -= n;
+  }
+}
+
+// Свободно в очереди вывода, байт
+unsigned outRoom() {
+  return (serialOutTail + SERIAL_OUT_BUF - serialOutHead - 1) % SERIAL_OUT_BUF;
+}
+
+// ---------------- журнал заправок: flash ----------------
+// Сегменты /fill0.bin … по кругу, до LOG_SEGMENT_RECS записей в каждом;
+// заполнив сегмент, переходим к следующему, стирая самый старый. Дозапись —
+// пачкой от LOG_BATCH записей (или раз в LOG_FLUSH_MS). Износ по блокам
+// распределяет LittleFS.
+// Любой доступ к flash (и дозапись, и чтение выгрузки) — только пока помпы
+// всех станций стоят: он останавливает кэш обоих ядер, а с ним задачу
+// управления и прерывания вне IRAM. Если станции работают вперемешку и общего
+// простоя нет, а в кольце набралось LOG_HOLD_RECS записей (или выгрузка ждёт
+// чтения LOG_HOLD_MS), flashHold придерживает новые циклы: работающие
+// доходят до конца, и окно открывается не позже самого длинного цикла.
+// Простой по снимкам — лишь повод попросить окно: задача управления могла
+// как раз запустить цикл. Интерфейс поднимает flashHold с новым номером
+// запроса, управление в конце шага подтверждает номер, если ни одна станция
+// не в цикле (а новые до снятия flashHold не начнутся), — только тогда flash.
+// Выгрузка (команда log) идёт порциями по месту в очереди Serial, flash
+// читается порциями по LOG_DUMP_CHUNK записей; пока выгрузка дошла до
+// кольца ОЗУ, дозапись откладывается.
+
+struct LogStore {
+  bool ready;                     // LittleFS смонтирована
+  uint8_t slot;                   // Текущий сегмент
+  uint32_t slotRecs;              // Записей в нём
+  unsigned long flushes;          // Дозаписей
+  unsigned long flushMaxUs;       // Самая долгая дозапись, мкс
+  unsigned long failed;           // Неудачных дозаписей
+  unsigned long holds;            // Раз придерживали новые циклы ради flash
+};
+
+struct LogDump {
+  bool active;
+  uint8_t segsDone;               // Пройдено сегментов (от старейшего)
+  uint32_t rec;                   // Следующая запись сегмента
+  bool ram;                       // Сегменты пройдены — хвост из кольца ОЗУ
+  uint32_t ramPos;
+  FillRecord chunk[LOG_DUMP_CHUNK];
+  uint8_t chunkLen, chunkPos;
+  unsigned long waitMs;           // Порция выбрана — с этого момента ждём окна для чтения
+  unsigned long records, bad;
+};
+
+LogStore logStore;
+LogDump logDump;
+
+void logPath(char *buf, size_t cap, int slot) {
+  textCopy(buf, cap, TextBuf().add("/fill").add(slot).add(".bin").s);
+}
+
+// Записи сегмента с позиции first; возвращает прочитанное, записей
+int logReadRecords(int slot, uint32_t first, FillRecord *out, int n) {
+  char path[16];
+  logPath(path, sizeof(path), slot);
+  return (int)(halFsRead(path, first * sizeof(FillRecord), out, n * sizeof(FillRecord)) / sizeof(FillRecord));
+}
+
+// При запуске: найти самый свежий сегмент и продолжить нумерацию записей
+void logStoreOpen() {
+  logStore.ready = halFsBegin();
+  if (!logStore.ready) return;
+  bool found = false;
+  uint32_t newest = 0;
+  for (int k = 0; k < LOG_SEGMENTS; k++) {
+    FillRecord first;
+    if (logReadRecords(k, 0, &first, 1) != 1 || !recordValid(first)) continue;
+    if (!found || (int32_t)(first.seq - newest) > 0) {
+      found = true;
+      newest = first.seq;
+      logStore.slot = (uint8_t)k;
     }
   }
+  if (!found) return;                                                // Журнал пуст — с сегмента 0
+  char path[16];
+  logPath(path, sizeof(path), logStore.slot);
+  long size = halFsSize(path);
+  logStore.slotRecs = (uint32_t)(size / (long)sizeof(FillRecord));
+  FillRecord last;
+  bool lastOk = logReadRecords(logStore.slot, logStore.slotRecs - 1, &last, 1) == 1 && recordValid(last);
+  logSeq = lastOk ? last.seq + 1 : newest + logStore.slotRecs;
+  if (size % (long)sizeof(FillRecord) || !lastOk) logStore.slotRecs = LOG_SEGMENT_RECS;  // Хвост оборван — дальше в новом сегменте
+}
 
-  // --- Фаза A: наполнение микс-бака ---
-  if (unit.fillingMix) {
-    bool mixOverflow = digitalRead(unit.mixMoisturePin) == HIGH;     // Контроль перелива микс-бака
-    int remainingL = max((int)((unit.pumpStopTime - millis()) / MS_PER_LITER), 0); // Оставшееся «время»
-    if (remainingL != unit.currentLiters) {                          // Обновлять строку только при изменении
-      unit.currentLiters = remainingL;
-      updateStatusLine(unit, 2, "mix <- " + String(unit.currentLiters)); // Отсчёт для фазы A
+// Перенести всё из кольца во flash (задача интерфейса)
+void logFlush() {
+  uint32_t tail = logTail.load();
+  uint32_t head = logHead.load();
+  char path[16];
+  while (tail != head) {
+    if (logStore.slotRecs >= LOG_SEGMENT_RECS) {                     // Сегмент полон — следующий по кругу
+      logStore.slot = (uint8_t)((logStore.slot + 1) % LOG_SEGMENTS);
+      logPath(path, sizeof(path), logStore.slot);
+      halFsRemove(path);
+      logStore.slotRecs = 0;
     }
+    uint32_t n = head - tail;                                        // Непрерывный кусок кольца, не за край сегмента
+    n = min(n, (uint32_t)(LOG_RING - tail % LOG_RING));
+    n = min(n, (uint32_t)(LOG_SEGMENT_RECS - logStore.slotRecs));
+    logPath(path, sizeof(path), logStore.slot);
+    if (!halFsAppend(path, &logRing[tail % LOG_RING], n * sizeof(FillRecord))) {
+      logStore.failed++;
+      logStore.slotRecs = LOG_SEGMENT_RECS;                          // Сегмент мог остаться с обрывком — повтор в следующем
+      return;
+    }
+    logStore.slotRecs += n;
+    tail += n;
+    logTail.store(tail);
+  }
+}
+
+// Выгрузке нужна следующая порция из flash
+inline bool logDumpReadDue() {
+  return logDump.active && !logDump.ram && logDump.chunkPos >= logDump.chunkLen && logDump.segsDone < LOG_SEGMENTS;
+}
 
-    if (millis() >= unit.pumpStopTime || mixOverflow) {              // Условия завершения фазы A
-      if (mixOverflow) unit.batchLiters = MIX_TANK_CAPACITY;         // Если сработал датчик — бак полный
-      stopFillingMix(unit);                                          // Остановить помпу №1 и закрыть клапаны
-      startPumpingDrone(unit);                                       // Перейти к фазе B
+// Порция выгрузки: сегменты от старейшего, текущий — последним (дозапись в
+// него во время выгрузки тоже попадёт в порции, кольцо — с logTail)
+void logDumpRead() {
+  while (logDump.segsDone < LOG_SEGMENTS) {
+    int slot = (logStore.slot + 1 + logDump.segsDone) % LOG_SEGMENTS;
+    int n = logReadRecords(slot, logDump.rec, logDump.chunk, LOG_DUMP_CHUNK);
+    logDump.chunkLen = (uint8_t)n;
+    logDump.chunkPos = 0;
+    logDump.rec += n;
+    if (n < LOG_DUMP_CHUNK) {
+      logDump.segsDone++;
+      logDump.rec = 0;
     }
+    if (n) return;
+  }
+}
+
+// Шаг журнала (задача интерфейса): дозапись, когда набралась пачка или
+// записи залежались, и чтение для выгрузки — только пока ни одна помпа не
+// работает; иначе, если ждать уже нельзя, — придержать новые циклы
+void logService(unsigned long now, bool pumping) {
+  if (!logStore.ready) return;
+  uint32_t tail = logTail.load();
+  uint32_t pending = logHead.load() - tail;
+  bool flushOk = !logDump.active || (!logDump.ram && logStore.slotRecs + pending <= LOG_SEGMENT_RECS);  // Выгрузка не собьётся
+  bool flushDue = pending && flushOk && (pending >= LOG_BATCH || now - logRing[tail % LOG_RING].timeMs >= LOG_FLUSH_MS);
+  bool readDue = logDumpReadDue();
+  if (!readDue) logDump.waitMs = now;
+  bool urgent = (flushDue && pending >= LOG_HOLD_RECS) || (readDue && now - logDump.waitMs >= LOG_HOLD_MS);
+  if ((!flushDue && !readDue) || (pumping && !urgent)) {             // Нечего делать или ждём общего простоя
+    flashHold.store(false);
+    return;
+  }
+  if (!flashHold.load()) {                                           // Запрос окна
+    if (pumping) logStore.holds++;
+    flashHoldSeq.fetch_add(1);
+    flashHold.store(true);
+  }
+  if (flashIdleSeq.load() != flashHoldSeq.load()) return;            // Управление ещё не подтвердило
+  if (flushDue) {
+    unsigned long t0 = micros();
+    logFlush();
+    unsigned long us = micros() - t0;
+    logStore.flushes++;
+    if (us > logStore.flushMaxUs) logStore.flushMaxUs = us;
   }
+  if (readDue) logDumpRead();
+  flashHold.store(false);
+}
+
+#define LOG_LINE_MAX 128               // Длина строки выгрузки с запасом
+
+void outRecord(const FillRecord &r) {
+  outText("fill");
+  outKV("seq", r.seq);
+  outKV("ms", r.timeMs);
+  if (r.event != EV_BOOT) outKV("unit", r.unit + 1UL);
+  outText(" ev="); outText(r.event < EV_COUNT ? LOG_EVENT_NAMES[r.event] : "?");
+  if (r.event != EV_BOOT) {
+    outKV("target_l", r.targetLiters);
+    outKV("delivered_ml", r.deliveredMl);
+    outKV("mix_ms", r.mixMs);
+    outKV("drone_ms", r.droneMs);
+  }
+  outText("\n");
+}
 
-  // --- Фаза B: перекачка в дрон ---
-  if (unit.pumpRunning) {
-    bool droneOverflow = digitalRead(unit.moisturePin) == HIGH;      // Контроль перелива бака дрона
-    int remainingL = max((int)((unit.pumpStopTime - millis()) / MS_PER_LITER), 0); // Оставшееся «время»
-    if (remainingL != unit.currentLiters) {                          // Обновление строки статуса
-      unit.currentLiters = remainingL;
-      updateStatusLine(unit, 2, "pump on <- " + String(unit.currentLiters)); // Отсчёт для фазы B
+// Следующая запись выгрузки: порции сегментов (читает logService), затем кольцо ОЗУ
+bool logDumpNext(FillRecord &r) {
+  if (!logDump.ram) {
+    if (logDump.chunkPos < logDump.chunkLen) {
+      r = logDump.chunk[logDump.chunkPos++];
+      return true;
     }
+    if (logStore.ready && logDump.segsDone < LOG_SEGMENTS) return false;  // Ждём порцию из flash
+    logDump.ram = true;
+    logDump.ramPos = logTail.load();
+  }
+  if (logDump.ramPos == logHead.load()) return false;
+  r = logRing[logDump.ramPos++ % LOG_RING];
+  return true;
+}
 
-    // RGB-индикация
-    if (unit.targetLiters > 0) {
-      int pumpedThisBatch = unit.batchLiters - remainingL;           // Сколько литров перелилось в этой партии
-      if (pumpedThisBatch < 0) pumpedThisBatch = 0;                 
-      float progress01 = (float)(unit.deliveredLiters + pumpedThisBatch) / (float)unit.targetLiters; // 0..1
-      ledUpdateGradient(unit, progress01);                           // Обновить цвет по прогрессу
+// Шаг выгрузки (задача интерфейса): строки — пока есть место в очереди Serial
+void logDumpStep() {
+  if (!logDump.active) return;
+  while (outRoom() >= LOG_LINE_MAX) {
+    FillRecord r;
+    if (!logDumpNext(r)) {
+      if (!logDump.ram) return;                                      // Продолжим в следующем шаге
+      outText("log end");
+      outKV("records", logDump.records);
+      outKV("bad", logDump.bad);
+      outText("\n");
+      logDump.active = false;
+      return;
     }
+    if (!recordValid(r)) { logDump.bad++; continue; }
+    logDump.records++;
+    outRecord(r);
+  }
+}
 
-    if (millis() >= unit.pumpStopTime || droneOverflow) {            // Условия завершения фазы B
-      stopPumpingDrone(unit);                                        // Остановить помпу №2
+// Счётчики пишут задачи-владельцы, отчёты лишь читают: возможная рассинхронизация
+// соседних полей на одно событие для диагностики допустима.
 
-      if (droneOverflow) {                                           // Авария по датчику дрона
-        ledRed(unit);                                                // Мгновенно красный
-        unit.deliveredLiters = unit.targetLiters;                    // Считаем цель достигнутой (останавливаем цикл)
-        updateStatusLine(unit, 2, "filled in ");                     // Сообщение о переливе
-        unit.waitBeforeReset = true;                                 
-        unit.waitStartTime = millis();
-      } else {                                                       // Нормальное окончание заправки по времени
-        unit.deliveredLiters += unit.batchLiters;                    // Добавляем в прогресс
-        if (unit.deliveredLiters >= unit.targetLiters) {             // При завершении
-          unit.deliveredLiters = unit.targetLiters;                  
-          updateStatusLine(unit, 2, "pump off ");                    // Сообщение «помпа выкл»
-          ledOff(unit);                                              // Готово — выключаем диод
-          unit.waitBeforeReset = true;                               
-          unit.waitStartTime = millis();
-        } else {                                                     // Иначе — повторить
-          startFillingMix(unit);                                     // Вернуться к фазе A
-        }
+// ---------------- Serial: двоичный протокол ----------------
+// Кадр хоста начинается с SOF на месте первого символа строки команды. Кадры
+// в очередь вывода ложатся только целиком. Пока хост не прислал HELLO, кадры
+// идут лишь в ответ на его кадры (отказы, STATUS_REQ) — в терминале человека
+// только текст; уведомления и ACK задачи управления ждут HELLO в jobNotify.
+
+ProtoParser protoRx;                 // Принимаемый кадр
+unsigned long protoRxMs = 0;         // Последний байт кадра
+bool protoHost = false;              // Был HELLO — уведомления включены
+uint32_t bootId = 0;                 // Номер запуска для HELLO (случайный)
+uint8_t statusShown[NUM_UNITS];      // Состояние станции в последнем STATUS (0xFF — слать заново)
+
+struct ProtoStats {
+  unsigned long frames;           // Верных кадров хоста
+  unsigned long bad;              // Длина или CRC неверны
+  unsigned long timeouts;         // Кадр оборван
+};
+
+ProtoStats protoStats;
+
+void outBytes(const uint8_t *p, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    serialOut[serialOutHead] = (char)p[i];
+    serialOutHead = (serialOutHead + 1) % SERIAL_OUT_BUF;
+  }
+}
+
+// Кадр целиком или ничего: обрывок хост всё равно отбросит по CRC
+bool outFrame(uint8_t type, const void *payload, uint8_t len) {
+  if (outRoom() < (unsigned)len + 4) return false;
+  uint8_t f[PROTO_MAX_FRAME];
+  outBytes(f, protoEncode(f, type, payload, len));
+  return true;
+}
+
+bool protoStatus(int idx, const UnitSnapshot &s) {
+  MsgStatus m;
+  m.unit = (uint8_t)idx;
+  m.state = s.state;
+  m.jobId = s.jobId;
+  m.targetLiters = (uint8_t)s.targetLiters;
+  m.queued = s.queued;
+  m.held = s.jobsHeld;
+  m.deliveredMl = s.deliveredMl > 0 ? (uint32_t)s.deliveredMl : 0;
+  return outFrame(MSG_STATUS, &m, sizeof(m));
+}
+
+// Отказ, найденный ещё при приёме (до задачи управления)
+void protoReject(uint8_t type, uint16_t jobId, uint8_t result, uint8_t unit) {
+  MsgAck a;
+  a.type = type;
+  a.jobId = jobId;
+  a.result = result;
+  a.queued = 0;
+  if (unit < NUM_UNITS) {
+    UnitSnapshot s;
+    readSnapshot(unit, s);
+    a.queued = s.queued;
+  }
+  outFrame(MSG_ACK, &a, sizeof(a));
+}
+
+void protoHandle(const ProtoParser &f) {
+  protoStats.frames++;
+  switch (f.type) {
+    case MSG_HELLO_REQ: {
+      protoHost = true;
+      MsgHello h;
+      h.version = PROTO_VERSION;
+      h.units = NUM_UNITS;
+      h.queueLen = JOB_QUEUE_LEN;
+      h.bootId = bootId;
+      outFrame(MSG_HELLO, &h, sizeof(h));
+      memset(statusShown, 0xFF, sizeof(statusShown));                // Состояние всех станций — заново
+      return;
+    }
+    case MSG_ENQUEUE:
+    case MSG_CANCEL:
+    case MSG_RESUME: {
+      JobRequest r;
+      memset(&r, 0, sizeof(r));
+      r.type = f.type;
+      if (f.type == MSG_ENQUEUE && f.len == sizeof(MsgEnqueue)) {
+        MsgEnqueue m;
+        memcpy(&m, f.payload, sizeof(m));
+        r.unit = m.unit;
+        r.liters = m.liters;
+        r.priority = m.priority;
+        r.jobId = m.jobId;
+      } else if (f.type == MSG_CANCEL && f.len == sizeof(MsgCancel)) {
+        MsgCancel m;
+        memcpy(&m, f.payload, sizeof(m));
+        r.unit = m.unit;
+        r.jobId = m.jobId;
+      } else if (f.type == MSG_RESUME && f.len == 1) {
+        r.unit = f.payload[0];
+      } else break;
+      uint8_t result = RES_OK;
+      if (!r.jobId && f.type != MSG_RESUME) result = RES_BAD_FRAME;
+      else if (r.unit >= NUM_UNITS) result = RES_BAD_UNIT;
+      else if (f.type == MSG_ENQUEUE && (r.liters < 1 || r.liters > POT_MAX_LITERS)) result = RES_BAD_LITERS;
+      else if (!jobRequests.push(r)) result = RES_QUEUE_FULL;        // Ответ OK пришлёт задача управления
+      if (result != RES_OK) protoReject(f.type, r.jobId, result, r.unit);
+      return;
+    }
+    case MSG_STATUS_REQ: {
+      if (f.len != 1) break;
+      uint8_t unit = f.payload[0];
+      if (unit != PROTO_ALL_UNITS && unit >= NUM_UNITS) { protoReject(f.type, 0, RES_BAD_UNIT, unit); return; }
+      for (int i = 0; i < NUM_UNITS; i++) {
+        if (unit != PROTO_ALL_UNITS && unit != i) continue;
+        UnitSnapshot s;
+        readSnapshot(i, s);
+        protoStatus(i, s);
       }
+      return;
+    }
+  }
+  protoReject(f.type, 0, RES_BAD_FRAME, PROTO_ALL_UNITS);
+}
+
+// Ответы и уведомления задачи управления — в очередь вывода, пока есть место.
+// До HELLO остаются в кольце (итог задания, шедшего при сбросе, не теряется);
+// кольцо полно — jobSend считает отброшенные.
+void protoNotifyStep() {
+  ProtoFrame f;
+  while (protoHost && outRoom() >= PROTO_MAX_FRAME && jobNotify.pop(f)) outBytes(f.bytes, f.len);
+}
+
+// STATUS при смене состояния станции; нет места — попытка в следующем шаге
+void protoWatch(int idx, const UnitSnapshot &s) {
+  if (protoHost && s.state != statusShown[idx] && protoStatus(idx, s)) statusShown[idx] = s.state;
+}
+
+void reportTask(const char *name, const TaskTiming &t) {
+  unsigned long runs = t.runs ? t.runs : 1;
+  outText("task "); outText(name);
+  outKV("runs", t.runs);
+  outKV("period_min_us", t.runs > 1 ? t.minPeriodUs : 0);
+  outKV("period_max_us", t.maxPeriodUs);
+  outKV("jitter_us", t.runs > 1 ? t.maxPeriodUs - t.minPeriodUs : 0);
+  outKV("exec_avg_us", t.sumExecUs / runs);
+  outKV("exec_max_us", t.maxExecUs);
+  outHist("period_hist", t.periodHist, CYCLE_HIST_BUCKETS);
+  outHist("exec_hist", t.execHist, CYCLE_HIST_BUCKETS);
+}
+
+// Время цикла задач; per_unit при разных NUM_UNITS показывает, что цена станции постоянна
+// (в sim/ micros() виртуальное — там цену прохода меряет make bench по часам хоста)
+void cmdTasks() {
+  reportTask("control", controlTiming);
+  outKV("units", NUM_UNITS);
+  outKV("tick_per_unit_ns", (unsigned long)(1000ULL * controlTiming.sumWorkUs / (controlTiming.runs ? controlTiming.runs : 1) / NUM_UNITS));
+  outText("\n");
+  reportTask("ui", uiTiming);
+  outText("\n");
+}
+
+// Длительности фаз каждой станции и причины их завершения
+void cmdPhases() {
+  static const char *const names[PH_COUNT] = { "mix", "drone", "wait" };
+  for (int i = 0; i < NUM_UNITS; i++) {
+    const UnitProfile &pr = units[i].prof;
+    for (int ph = 0; ph < PH_COUNT; ph++) {
+      const PhaseStats &st = pr.phase[ph];
+      outText("phase"); outKV("unit", i + 1); outText(" "); outText(names[ph]);
+      outKV("n", st.count);
+      outKV("last_ms", st.lastMs);
+      outKV("min_ms", st.minMs);
+      outKV("max_ms", st.maxMs);
+      outKV("avg_ms", st.count ? st.sumMs / st.count : 0);
+      outKV("sensor", st.bySensor);
+      outKV("timer", st.byTimer);
+      outText("\n");
+    }
+    outText("trips"); outKV("unit", i + 1);
+    outKV("mix", pr.mixTrips);
+    outKV("drone", pr.droneTrips);
+    outKV("cycles", pr.cycles);
+    outKV("faults", pr.faults);
+    outText("\n");
+  }
+}
+
+// Производительность и текущие калибровки — данные для подбора MS_PER_LITER и порций
+void cmdFlow() {
+  unsigned long uptime = millis();
+  for (int i = 0; i < NUM_UNITS; i++) {
+    const Unit &u = units[i];
+    const UnitProfile &pr = u.prof;
+    outText("flow"); outKV("unit", i + 1);
+    outKV10("delivered_l", pr.deliveredMl / 100);
+    outKV("active_s", pr.activeMs / 1000);
+    outKV10("lpm", pr.activeMs ? (unsigned long)((unsigned long long)pr.deliveredMl * 600ULL / pr.activeMs) : 0);   // Устойчивая, за время циклов
+    outKV10("lph", uptime ? (unsigned long)((unsigned long long)pr.deliveredMl * 36000ULL / uptime) : 0);          // С учётом простоя, с запуска
+    outKV10("last_lpm", (unsigned long)u.lastRateLpm10);
+    outKV("mix_ms_per_l", u.mixFlow.msPerLiter);
+    outKV("drone_ms_per_l", u.droneFlow.msPerLiter);
+    outKV("mix_ul_per_pulse", u.mixFlow.ulPerPulse);
+    outKV("drone_ul_per_pulse", u.droneFlow.ulPerPulse);
+    outKV("tank_l", MIX_TANK_CAPACITY);
+#if PIPELINED_REFILL
+    outKV("prime_l", PIPELINE_PRIME_LITERS);
+#endif
+    outText("\n");
+  }
+}
+
+void cmdCutoff() {
+  outText("cutoff");
+  outKV("events", cutoffStats.events);
+  outKV("polled", cutoffStats.polled);
+  outKV("min_ns", cutoffStats.events ? cutoffStats.minNs : 0);
+  outKV("max_ns", cutoffStats.maxNs);
+  outKV("ack_max_us", cutoffStats.ackMaxUs);
+  outHist("hist", cutoffStats.hist, CUTOFF_HIST_BUCKETS);
+  outText("\n");
+}
+
+void cmdLcd() {
+  outText("lcd");
+  outKV("frames", lcdStats.frames);
+  outKV("bytes", lcdStats.lcdBytes);
+  outKV("i2c_Bps", lcdStats.i2cBytesPerSec);
+  outKV("frame_us", lcdStats.frameUs);
+  outKV("slice_max_us", lcdStats.maxSliceUs);
+  outText("\n");
+}
+
+void cmdHeap() {
+  outText("heap");
+  outKV("free", heapStats.freeBytes);
+  outKV("min_free", heapStats.minFreeBytes);
+  outKV("largest", heapStats.largestBlock);
+  outKV("frag_pct", heapStats.fragPct);
+  outKV("blocks", heapStats.allocatedBlocks);
+  outKV("changes", heapStats.changes);
+  outKV("serial_dropped", serialOutDropped);
+  outText("\n");
+}
+
+void outPot(const PotInput &p) {
+  outKV("pin", (unsigned long)p.pin);
+  outKV("raw", (unsigned long)p.raw);
+  outKV("filtered", (unsigned long)((p.filt + 8) >> 4));
+  outKV("liters", (unsigned long)p.liters);
+  outKV("sample_us", p.sampleUs);
+  outText("\n");
+}
+
+void cmdPot() {
+  outText("pot shared"); outPot(sharedPot);
+  for (int i = 0; i < NUM_UNITS; i++) {
+    if (stationPots[i].pin < 0) continue;
+    outText("pot"); outKV("unit", i + 1); outPot(stationPots[i]);
+  }
+}
+
+void cmdLogStat() {
+  outText("log");
+  outKV("fs", logStore.ready);
+  outKV("next_seq", logSeq);
+  outKV("pending", logHead.load() - logTail.load());
+  outKV("dropped", logDropped);
+  outKV("segment", logStore.slot);
+  outKV("segment_recs", logStore.slotRecs);
+  outKV("flushes", logStore.flushes);
+  outKV("flush_max_us", logStore.flushMaxUs);
+  outKV("failed", logStore.failed);
+  outKV("holds", logStore.holds);
+  outText("\n");
+}
+
+// Выгрузка журнала; строки идут из serialService по мере места в очереди
+void cmdLog() {
+  if (logDump.active) { outText("log busy\n"); return; }
+  memset(&logDump, 0, sizeof(logDump));
+  logDump.active = true;
+  outText("log begin");
+  outKV("next_seq", logSeq);
+  outText("\n");
+}
+
+void cmdBoot() {
+  outText("boot reason="); outText(halResetReason());
+  outKV("setup_us", bootInfo.setupUs);
+  outKV("safe_us", bootInfo.safeUs);
+  outKV("ready_us", bootInfo.readyUs);
+  outKV("lcd_us", bootInfo.lcdUs);
+  outKV("checkpoint", bootInfo.checkpoint);
+  outKV("resumed", bootInfo.resumed);
+  outKV("aborted", bootInfo.aborted);
+  outText("\n");
+}
+
+// Очереди заданий и приём кадров хоста
+void cmdJobs() {
+  for (int i = 0; i < NUM_UNITS; i++) {
+    UnitSnapshot s;
+    readSnapshot(i, s);
+    outText("jobs"); outKV("unit", i + 1);
+    outKV("job", s.jobId);
+    outKV("queued", s.queued);
+    outKV("held", s.jobsHeld);
+    outText("\n");
+  }
+  outText("jobs");
+  outKV("enqueued", jobStats.enqueued);
+  outKV("rejected", jobStats.rejected);
+  outKV("cancelled", jobStats.cancelled);
+  outKV("started", jobStats.started);
+  outKV("done", jobStats.done);
+  outKV("faults", jobStats.faults);
+  outKV("notify_dropped", jobStats.notifyDropped);
+  outKV("host", protoHost);
+  outKV("frames", protoStats.frames);
+  outKV("bad", protoStats.bad);
+  outKV("timeouts", protoStats.timeouts);
+  outText("\n");
+}
+
+void cmdAll() {
+  cmdBoot();
+  cmdTasks();
+  cmdPhases();
+  cmdFlow();
+  cmdCutoff();
+  cmdLcd();
+  cmdHeap();
+  cmdPot();
+  cmdLogStat();
+  cmdJobs();
+}
+
+// Новое окно замеров: каждый счётчик сбрасывает его владелец
+void cmdReset() {
+  controlTiming.resetReq = true;
+  uiTiming.resetReq = true;
+  profileResetReq = true;
+  lcdStats.maxSliceUs = 0;
+  outText("ok\n");
+}
+
+void cmdHelp();
+
+struct Command {
+  const char *name;
+  void (*run)();
+  const char *help;
+};
+
+const Command commands[] = {
+  { "help",   cmdHelp,   "this list" },
+  { "boot",   cmdBoot,   "reset reason, boot-to-ready time, resumed cycles" },
+  { "tasks",  cmdTasks,  "task period/exec, jitter, cycle histograms" },
+  { "phases", cmdPhases, "per-unit phase durations, sensor/timer ends, trips" },
+  { "flow",   cmdFlow,   "delivered liters, sustained L/min and L/h, calibration" },
+  { "cutoff", cmdCutoff, "overflow ISR edge-to-relay latency" },
+  { "lcd",    cmdLcd,    "LCD/I2C load" },
+  { "heap",   cmdHeap,   "heap and serial queue" },
+  { "pot",    cmdPot,    "setpoint inputs: raw/filtered ADC, liters" },
+  { "log",    cmdLog,    "stream the fill log (flash, then RAM)" },
+  { "logstat", cmdLogStat, "fill log: records, flushes, drops" },
+  { "jobs",   cmdJobs,   "host job queues and protocol frames" },
+  { "all",    cmdAll,    "everything above" },
+  { "reset",  cmdReset,  "start a new measurement window" },
+};
+
+void cmdHelp() {
+  for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+    outText(commands[i].name); outText(" - "); outText(commands[i].help); outText("\n");
+  }
+}
+
+void runCommand(const char *line) {
+  for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+    if (strcmp(line, commands[i].name) == 0) { commands[i].run(); return; }
+  }
+  outText("unknown command, try help\n");
+}
+
+// Шаг Serial (задача интерфейса): приём команд, автоотчёт, передача очереди
+void serialService(unsigned long now) {
+  if (protoRx.pos && now - protoRxMs >= PROTO_RX_TIMEOUT_MS) {       // Хост замолчал посреди кадра
+    protoRx.pos = 0;
+    protoStats.timeouts++;
+  }
+  for (int n = 0; n < SERIAL_CMD_MAX && Serial.available() > 0; n++) {   // Не больше строки (или кадра) за шаг
+    char c = (char)Serial.read();
+    if (protoRx.pos || ((uint8_t)c == PROTO_SOF && !cmdLen && !cmdTooLong)) {
+      protoRxMs = now;
+      ProtoFeed r = protoFeed(protoRx, (uint8_t)c);
+      if (r == PROTO_FRAME) protoHandle(protoRx);
+      else if (r == PROTO_ERROR) protoStats.bad++;
+      continue;
+    }
+    if (c == '\n' || c == '\r') {
+      cmdLine[cmdLen] = 0;
+      if (cmdLen && !cmdTooLong) runCommand(cmdLine);
+      cmdLen = 0;
+      cmdTooLong = false;
+    } else if (cmdLen < SERIAL_CMD_MAX) {
+      cmdLine[cmdLen++] = c;
+    } else {
+      cmdTooLong = true;
+    }
+  }
+#if BENCH_REPORT_MS
+  if (now - benchWindowStart >= BENCH_REPORT_MS) {
+    benchWindowStart = now;
+    cmdAll();
+    controlTiming.resetReq = true;
+    uiTiming.resetReq = true;
+    lcdStats.maxSliceUs = 0;
+  }
+#else
+  (void)now;
+#endif
+  logDumpStep();
+  serialDrain();
+}
+
+// ----------- шаг управления -----------
+// Не блокируется: ни delay(), ни ожидания отпускания кнопки. Все сроки — по
+// отметкам millis() внутри автомата станции. Каждый шаг продвигает автоматы
+// ВСЕХ станций; currentUnit выбирает лишь станцию на экране, к которой
+// относятся общий потенциометр и START. АЦП здесь не читается — цели готовит
+// задача интерфейса (potService). Возвращает время шагов автоматов, мкс.
+unsigned long controlTick(unsigned long now) {
+  if (!bootInfo.readyUs) bootInfo.readyUs = micros();                // Первый шаг: ввод принимается
+  if (profileResetReq) {                                             // Команда reset: счётчики станций и отсечки
+    for (int i = 0; i < NUM_UNITS; i++) memset(&units[i].prof, 0, sizeof(units[i].prof));
+    memset(&cutoffStats, 0, sizeof(cutoffStats));
+    cutoffStats.minNs = UINT32_MAX;
+    profileResetReq = false;
+  }
+  handleUnitSwitch(now);                                             // Обработка переключения станций
+  bool startPressed = buttonPressed(startBtn, now);                  // Кнопку опрашиваем каждый шаг
+
+  unsigned long tickStart = micros();
+  for (int i = 0; i < NUM_UNITS; i++) {                              // Датчики → реле → статус каждой станции
+    tickUnit(units[i], now);
+  }
+  unsigned long tickUs = micros() - tickStart;
+
+  for (int i = 0; i < NUM_UNITS; i++) {                              // В ожидании цель следует за задатчиком
+    Unit &u = units[i];
+    int setpoint = potSetpoint(i);
+    if (u.state == ST_IDLE && setpoint > 0) {
+      u.targetLiters = setpoint;
+      u.currentLiters = setpoint;                                    // Для согласованности отображения
     }
   }
 
-  // --- Пауза перед разрешением нового запуска ---
-  if (unit.waitBeforeReset) {
-    if (millis() - unit.waitStartTime >= 1000) {                     
-      unit.readyToStart = true;                                      // Разрешить новый цикл
-      unit.waitBeforeReset = false;                                  // Снять флаг паузы
-      unit.needsDisplayUpdate = true;                              
-      unit.fillingMix = false;                                       // Для нормализации снимаем флаги фаз
-      unit.pumpRunning = false;
-      updateStatusLine(unit, 2, "ready again");                      // Сообщение о повторной подготовке к работе
-      ledOff(unit);                                                  // Выключаем диод (в т.ч. после аварии)
+  jobService(now);                                                   // Задания хоста: запросы, автостарт после паузы
+
+  Unit &unit = units[currentUnit];                                   // станция на экране
+  startHeld |= startPressed;                                         // Нажатие в окно для flash — дождётся его конца
+  if (startHeld && !flashHold.load()) {
+    startHeld = false;
+    unit.jobsHeld = false;                                           // Оператор у станции: авария разобрана
+    if (unit.state == ST_IDLE && unit.targetLiters > 0 && !jobQueues[currentUnit].count) {
+      startCycle(unit, now);                                         // Старт цикла по кнопке (задания — в jobService)
     }
   }
 
-  delay(50);                                                       
-}
\ No newline at end of file
+  flashAck();                                                        // Окно для flash — после всех пусков шага
+  for (int i = 0; i < NUM_UNITS; i++) publishUnit(i);                // Снимки для интерфейса
+  return tickUs;
+}
+
+// ----------- шаг интерфейса -----------
+
+int ledShown[NUM_UNITS];             // Выведенный цвет станции 0xRRGGBB (setupUnitIO гасит диоды)
+
+// Цвет по режиму из снимка; в LEDC пишем только при смене цвета
+void ledApply(const Unit &u, const UnitSnapshot &s, int &shown) {
+  int r = 0, g = 0, b = 0;
+  if (s.ledMode == LED_RED) r = 255;
+  else if (s.ledMode == LED_GRADIENT) colorFromProgress(s.progress01, r, g, b);
+  int rgb = (r << 16) | (g << 8) | b;
+  if (rgb == shown) return;
+  ledWriteRGB(u, r, g, b);
+  shown = rgb;
+}
+
+// Кадр станции целиком; на LCD уйдут лишь отличия от выведенного
+void renderUnit(int idx, const UnitSnapshot &s) {
+  lcdPrintClear(0, 0, TextBuf().add("station ").add(idx + 1).s);    // Заголовок
+  lcdPrintClear(0, 1, TextBuf().add("liters: ").add(s.targetLiters).s); // Строка 1 — целевые литры
+  lcdPrintClear(0, 2, s.line2);
+  lcdPrintClear(0, 3, s.line3);
+}
+
+void uiTick(unsigned long now) {
+  int shownUnit = currentUnit;
+  bool pumping = false;
+  protoNotifyStep();                                                 // Уведомления — раньше STATUS по тем же снимкам
+  for (int i = 0; i < NUM_UNITS; i++) {
+    UnitSnapshot s;
+    readSnapshot(i, s);
+    ledApply(units[i], s, ledShown[i]);                              // Пины/каналы станции не меняются после setup()
+    protoWatch(i, s);                                                // Смена состояния — хосту
+    if (i == shownUnit) renderUnit(i, s);
+    pumping |= s.state == ST_FILL_MIX || s.state == ST_PUMP_DRONE;
+  }
+  logService(now, pumping);                                          // Журнал во flash — только пока помпы стоят
+  potService();                                                      // Задатчики литров: АЦП, фильтр, гистерезис
+  lcdService(now);                                                   // Вывод кадра на LCD — по расписанию, порциями
+  heapWatch(now);                                                    // Контроль кучи (в рабочем цикле — без выделений)
+  serialService(now);                                                // Команды и замеры — без ожидания UART
+}
+
+#if DUAL_CORE
+static_assert(pdMS_TO_TICKS(CONTROL_PERIOD_MS) > 0 && pdMS_TO_TICKS(UI_PERIOD_MS) > 0,
+              "период задачи короче тика FreeRTOS");
+
+void controlTask(void *) {
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(CONTROL_PERIOD_MS));        // Строгий период, без накопления ухода
+    unsigned long t0 = micros();
+    unsigned long tickUs = controlTick(millis());
+    timingRun(controlTiming, t0, micros(), tickUs);
+  }
+}
+
+void uiTask(void *) {
+  heapBaseline(millis());                                            // Стеки задач уже выделены — дальше куча неизменна
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(UI_PERIOD_MS));
+    unsigned long t0 = micros();
+    uiTick(millis());
+    timingRun(uiTiming, t0, micros(), 0);
+  }
+}
+#endif
+
+// ----------- глобальная инициализация -----------
+// Сначала — реле и станции (прерванный цикл продолжается за миллисекунды),
+// затем задача управления; медленное (LCD) — уже при работающем управлении.
+void setup() {
+  bootInfo.setupUs = micros();
+  for (int i = 0; i < NUM_UNITS; i++) {                              // Инициализация всех станций: реле — в OFF
+    setupUnitIO(units[i], i);                                        // Индекс для назначения PWM-каналов
+  }
+  Serial.begin(115200);                                              // UART для отладки
+  setupPots();                                                       // Задатчики литров (ADC) и первый опрос
+  pinMode(START_BTN_PIN, INPUT_PULLUP);                              // Кнопка старта
+  pinMode(SWITCH_BTN_PIN, INPUT_PULLUP);                             // Кнопка переключения
+
+  logStoreOpen();                                                    // Журнал заправок: LittleFS, продолжение нумерации
+  FillRecord boot;
+  memset(&boot, 0, sizeof(boot));
+  boot.event = EV_BOOT;
+  boot.timeMs = millis();
+  logPut(boot);
+  bootId = halRandom();                                              // Не boot.seq: не сброшенная во flash запись повторит номер
+
+  checkpointRestore(millis());                                       // Прерванные сбросом циклы — продолжить или остановить
+  jobRestore(millis());                                              // и сообщить хосту о заданиях этих циклов
+  for (int i = 0; i < NUM_UNITS; i++) publishUnit(i);                // Первые снимки — до запуска интерфейса
+  bootInfo.safeUs = micros();
+
+#if DUAL_CORE
+  xTaskCreatePinnedToCore(controlTask, "control", CONTROL_STACK, NULL, CONTROL_PRIORITY, NULL, CONTROL_CORE);
+#endif
+
+  Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);                              // I2C с явными SDA=21, SCL=22 (ESP32)
+  lcd.init();                                                        // Инициализация LCD
+  lcd.backlight();                                                   // Подсветка LCD
+  lcd.clear();                                                       // Экран и теневой буфер — пустые
+  lcdFrameReset();                                                   // Кадр станции выведет первый шаг интерфейса
+  bootInfo.lcdUs = micros();
+
+#if DUAL_CORE
+  xTaskCreatePinnedToCore(uiTask, "ui", UI_STACK, NULL, UI_PRIORITY, NULL, UI_CORE);
+#else
+  heapBaseline(millis());                                            // Дальше куча меняться не должна
+#endif
+}
+
+// ----------- главный цикл -----------
+// При DUAL_CORE работу ведут задачи управления и интерфейса, а loopTask
+// просто засыпает (не удаляется: освобождение его стека изменило бы кучу).
+// Без DUAL_CORE обе части идут по очереди, интерфейс — раз в UI_PERIOD_MS.
+unsigned long uiLastMs = 0;
+
+void loop() {
+#if DUAL_CORE
+  vTaskSuspend(NULL);
+#else
+  unsigned long t0 = micros();
+  unsigned long now = millis();
+  unsigned long tickUs = controlTick(now);
+  timingRun(controlTiming, t0, micros(), tickUs);
+
+  if (now - uiLastMs >= UI_PERIOD_MS) {
+    uiLastMs = now;
+    unsigned long t1 = micros();
+    uiTick(now);
+    timingRun(uiTiming, t1, micros(), 0);
+  }
+#endif
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+// Двоичный протокол по Serial — рядом с текстовыми командами:
+//   SOF(0xA5) LEN TYPE PAYLOAD[LEN] CRC8(LEN, TYPE, PAYLOAD)
+// Текстовые команды и отчёты — только ASCII, поэтому байт SOF однозначно
+// начинает кадр. Поля — little-endian (ESP32 и хост). Общий для прошивки
+// (src/main.cpp) и хостового клиента (sim/).
+//
+// Хост: HELLO → прошивка отвечает HELLO и с этого момента сама присылает
+// STATUS при смене состояния станции, JOB_START и JOB_END по заданиям; до
+// HELLO уведомления и ответы ACK копятся в прошивке (в пределах её кольца).
+// ENQUEUE ставит задание в очередь станции (ответ ACK); задание с большим
+// приоритетом идёт раньше, при равном — в порядке постановки. Очереди — в
+// ОЗУ: после сброса прошивки их нет (хост узнаёт по HELLO с boot_id). Задание,
+// шедшее при сбросе, прошивка помнит: после HELLO шлёт по нему JOB_START
+// заново (цикл продолжен) или JOB_END с JOB_ABORTED (цикл остановлен).
+// После аварии (JOB_END с JOB_OVERFLOW) очередь станции стоит, пока хост не
+// пришлёт RESUME или оператор не нажмёт START у этой станции; и после этого
+// задание не начнётся, пока датчик дрона мокрый (переполненный дрон не снят).
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PROTO_SOF          0xA5
+#define PROTO_VERSION      2
+#define PROTO_MAX_PAYLOAD  16
+#define PROTO_MAX_FRAME    (PROTO_MAX_PAYLOAD + 4)
+#define PROTO_ALL_UNITS    0xFF        // STATUS_REQ: все станции
+
+enum ProtoType : uint8_t {
+  // хост → прошивка
+  MSG_HELLO_REQ  = 0x01,              // —
+  MSG_ENQUEUE    = 0x02,              // MsgEnqueue
+  MSG_CANCEL     = 0x03,              // MsgCancel (только ещё не начатое задание)
+  MSG_STATUS_REQ = 0x04,              // номер станции или PROTO_ALL_UNITS
+  MSG_RESUME     = 0x05,              // номер станции: авария разобрана, очередь — дальше
+  // прошивка → хост
+  MSG_HELLO      = 0x81,              // MsgHello
+  MSG_ACK        = 0x82,              // MsgAck
+  MSG_STATUS     = 0x83,              // MsgStatus
+  MSG_JOB_START  = 0x84,              // MsgJobStart
+  MSG_JOB_END    = 0x85,              // MsgJobEnd
+};
+
+// Ответ на ENQUEUE/CANCEL/RESUME и на непонятный кадр
+enum ProtoResult : uint8_t {
+  RES_OK,
+  RES_QUEUE_FULL,                      // Очередь станции (или канал к задаче управления) полна
+  RES_BAD_UNIT,
+  RES_BAD_LITERS,
+  RES_NOT_FOUND,                       // CANCEL: задания нет в очереди (уже начато или не было)
+  RES_BAD_FRAME,                       // Неизвестный тип или длина
+};
+
+// Итог задания
+enum JobResult : uint8_t {
+  JOB_DONE,                            // Цель налита
+  JOB_OVERFLOW,                        // Перелив бака дрона — авария
+  JOB_ABORTED,                         // Остановлено сбросом прошивки (продолжать нельзя) — авария
+};
+
+struct __attribute__((packed)) MsgHello {
+  uint8_t version;                     // PROTO_VERSION
+  uint8_t units;                       // Станций
+  uint8_t queueLen;                    // Мест в очереди станции
+  uint32_t bootId;                     // Меняется при каждом запуске прошивки
+};
+
+struct __attribute__((packed)) MsgEnqueue {
+  uint8_t unit;                        // Станция (с 0)
+  uint8_t liters;                      // 1..100
+  uint8_t priority;                    // Больше — раньше
+  uint16_t jobId;                      // Выбирает хост, не 0
+};
+
+struct __attribute__((packed)) MsgCancel {
+  uint8_t unit;
+  uint16_t jobId;
+};
+
+struct __attribute__((packed)) MsgAck {
+  uint8_t type;                        // На какой кадр
+  uint16_t jobId;
+  uint8_t result;                      // ProtoResult
+  uint8_t queued;                      // Заданий в очереди станции после операции
+};
+
+struct __attribute__((packed)) MsgStatus {
+  uint8_t unit;
+  uint8_t state;                       // UnitState
+  uint16_t jobId;                      // Текущее задание (0 — цикл с кнопки или простой)
+  uint8_t targetLiters;
+  uint8_t queued;
+  uint8_t held;                        // 1 — очередь стоит после аварии (ждёт RESUME)
+  uint32_t deliveredMl;
+};
+
+struct __attribute__((packed)) MsgJobStart {
+  uint8_t unit;
+  uint16_t jobId;
+  uint8_t liters;
+};
+
+struct __attribute__((packed)) MsgJobEnd {
+  uint8_t unit;
+  uint16_t jobId;
+  uint8_t result;                      // JobResult
+  uint32_t deliveredMl;
+  uint32_t durationMs;                 // От старта задания (после сброса — от продолжения)
+};
+
+// CRC-8, полином 0x07
+inline uint8_t crc8(const uint8_t *p, size_t n, uint8_t crc = 0) {
+  while (n--) {
+    crc ^= *p++;
+    for (int i = 0; i < 8; i++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+// Собрать кадр в out (не меньше PROTO_MAX_FRAME); возвращает длину кадра
+inline size_t protoEncode(uint8_t *out, uint8_t type, const void *payload, uint8_t len) {
+  out[0] = PROTO_SOF;
+  out[1] = len;
+  out[2] = type;
+  for (uint8_t i = 0; i < len; i++) out[3 + i] = ((const uint8_t *)payload)[i];
+  out[3 + len] = crc8(out + 1, len + 2);
+  return len + 4;
+}
+
+// Приём кадра по байту
+struct ProtoParser {
+  uint8_t pos;                         // Принято байт кадра (0 — ждём SOF)
+  uint8_t len;
+  uint8_t type;
+  uint8_t payload[PROTO_MAX_PAYLOAD];
+};
+
+enum ProtoFeed { PROTO_MORE, PROTO_FRAME, PROTO_ERROR };
+
+// PROTO_FRAME — кадр в p.type/p.payload/p.len; PROTO_ERROR — длина или CRC
+// неверны, приём начат заново (байт до следующего SOF — не кадр)
+inline ProtoFeed protoFeed(ProtoParser &p, uint8_t c) {
+  if (p.pos == 0) {
+    if (c == PROTO_SOF) p.pos = 1;
+    return PROTO_MORE;
+  }
+  if (p.pos == 1) {
+    if (c > PROTO_MAX_PAYLOAD) { p.pos = 0; return PROTO_ERROR; }
+    p.len = c;
+    p.pos = 2;
+    return PROTO_MORE;
+  }
+  if (p.pos == 2) {
+    p.type = c;
+    p.pos = 3;
+    return PROTO_MORE;
+  }
+  if (p.pos < 3 + p.len) {
+    p.payload[p.pos - 3] = c;
+    p.pos++;
+    return PROTO_MORE;
+  }
+  p.pos = 0;
+  uint8_t head[2] = { p.len, p.type };
+  return crc8(p.payload, p.len, crc8(head, 2)) == c ? PROTO_FRAME : PROTO_ERROR;
+}